@@ -10,7 +10,10 @@
 //
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 #include <time.h>
+#include <omp.h>
 
 
 //
@@ -37,70 +40,644 @@
 #include "cwk1_extra.h"
 
 
+//
+// The hash index, bitmap and packed-memory array used by the SET_HASH, SET_BITMAP and SET_SORTED backends.
+//
+#include "cwk1_hash.h"
+#include "cwk1_bitmap.h"
+#include "cwk1_pma.h"
+
+
+//
+// The vectorised scan used for membership checks on small sets.
+//
+#include "cwk1_scan.h"
+
+
+//
+// The versioned snapshots that let readers iterate the set while it is being changed.
+//
+#include "cwk1_snapshot.h"
+
+
+//
+// The parallel merge sort used by sortSet().
+//
+#include "cwk1_sort.h"
+
+
+//
+// Parameters.
+//
+
+// Codes for the ways the set can be stored. Each keeps set[0..setSize-1] as the contiguous array printed
+// by printSet(), but differs in how membership is checked:
+// SET_LINEAR - scans the array (cwk1_scan.h) inside a critical section, so every insert is O(n) and
+//              serialised, but the scan is vectorised and fastest for small sets.
+// SET_HASH   - keeps a lock-free open-addressing index (cwk1_hash.h) alongside the array; O(1) checks.
+// SET_BITMAP - one bit per value in the range 0 to maxSetSize-1 (cwk1_bitmap.h); values outside this
+//              range are not added. The array is rebuilt in increasing order by syncSet() when needed.
+// SET_SORTED - keeps the values in order in a packed-memory array (cwk1_pma.h), with binary search
+//              lookups and amortised O(log^2 n) inserts. Also rebuilt by syncSet(); sortSet() does nothing.
+#define SET_LINEAR 0
+#define SET_HASH   1
+#define SET_BITMAP 2
+#define SET_SORTED 3
+// SET_AUTO   - starts as SET_LINEAR, and switches to SET_HASH once the set reaches SMALL_SET_THRESHOLD.
+#define SET_AUTO   4
+
+// The backend used by main(). SET_BITMAP suits main()'s values best, but lists the set in increasing
+// order rather than insertion order.
+#define SET_BACKEND SET_AUTO
+
+// Size at which SET_AUTO builds the hash index; below this, the vectorised scan is faster. Also the size
+// below which removeFromSet() searches on a single thread.
+#define SMALL_SET_THRESHOLD 2048
+
+// Comment out to add the initial values one at a time with addToSet() and rand() inside the parallel loop.
+// Otherwise each thread generates its share of the values into its own buffer from a reentrant stream,
+// and the buffers are merged by addManyToSet(); the set is then the same for a given seed whatever the
+// number of threads.
+#define BUFFERED_INSERT
+
+// Seed for the pseudo-random numbers. Zero means seed from the current time.
+#define RANDOM_SEED 0
+
+// Comment out to print the set with printSet(). Otherwise every change to the set is published as a
+// snapshot (cwk1_snapshot.h), and main() prints the latest one with printSetSnapshot(), which is safe to
+// call from a reporting thread while other threads carry on changing the set.
+#define SNAPSHOT_READS
+
+
+//
+// Backend state. Only the structures for the selected backend are allocated.
+//
+int setBackend = SET_LINEAR;
+HashIndex setIndex;
+Bitmap setBits;
+PackedArray setPacked;
+int setStale = 0;           // For SET_BITMAP and SET_SORTED, 1 if set[] and setSize are out of date.
+int setAutoPromote = 0;     // For SET_AUTO, 1 while the set is still SET_LINEAR.
+int setSnapshots = 0;       // 1 if changes are published as snapshots for concurrent readers.
+
+
+//
+// Selects the backend and allocates any structures it needs. Call straight after initSet(), as the
+// routines in cwk1_extra.h cannot be altered. Returns 0 if okay, -1 if there was an error.
+//
+int initSetBackend( int backend )
+{
+    setAutoPromote = ( backend==SET_AUTO );
+    if( backend==SET_AUTO ) backend = SET_LINEAR;
+
+    setBackend = backend;
+    setSize    = 0;
+
+    if( backend==SET_HASH   ) return hashInit( &setIndex, maxSetSize );
+    if( backend==SET_BITMAP ) return bitmapInit( &setBits, maxSetSize );
+    if( backend==SET_SORTED ) return pmaInit( &setPacked, maxSetSize );
+
+    return 0;
+}
+
+//
+// Deletes the resources allocated by initSetBackend(). Call just before destroySet().
+//
+void destroySetBackend()
+{
+    if( setBackend==SET_HASH   ) hashFree( &setIndex );
+    if( setBackend==SET_BITMAP ) bitmapFree( &setBits );
+    if( setBackend==SET_SORTED ) pmaFree( &setPacked );
+
+    if( setSnapshots ) destroySnapshots();
+    setSnapshots = 0;
+}
+
+//
+// Brings set[] and setSize up to date with the backend, which for SET_BITMAP and SET_SORTED means listing
+// the members in increasing order. Call before reading the set directly, e.g. before printSet().
+//
+void syncSet()
+{
+    if( !setStale ) return;
+
+    if( setBackend==SET_BITMAP ) setSize = bitmapMaterialise( &setBits, set );
+    if( setBackend==SET_SORTED ) setSize = pmaMaterialise( &setPacked, set );
+
+    // The whole array is rewritten, but the next snapshot still shares the chunks that came out the same.
+    markSnapshotChanged( 0, setSize );
+    setStale = 0;
+}
+
+//
+// Publishes the current contents of the set as a new snapshot version (cwk1_snapshot.h). Must be called
+// by one writer at a time, at a point where no other thread is changing the set.
+//
+void publishSet()
+{
+    syncSet();
+    publishSnapshot( set, setSize );
+}
+
+//
+// Starts publishing the set for concurrent readers, who can then call acquireSnapshot() and
+// releaseSnapshot(), or printSetSnapshot(), from any thread without locking. After this every routine
+// that changes the set publishes a new version, including addToSet() and removeFromSet() for each value.
+// A version shares the chunks of the array that did not change with the one before, so publishing after
+// one insert copies one chunk. SET_BITMAP and SET_SORTED must still relist the whole array each time,
+// so are better fed with the batch routines. Call straight after initSetBackend(). Returns 0 if okay,
+// -1 if there was an allocation error.
+//
+int enableSetSnapshots()
+{
+    if( initSnapshots( maxSetSize )==-1 ) return -1;
+
+    setSnapshots = 1;
+    markSnapshotChanged( 0, setSize );
+    publishSet();
+
+    return 0;
+}
+
+//
+// Called by the routines that change the set when they have finished, with the positions start to end-1
+// of set[] that they changed. SET_BITMAP and SET_SORTED pass an empty range, as syncSet() marks the
+// array when it relists it.
+//
+void setChanged( int start, int end )
+{
+    if( !setSnapshots ) return;
+
+    markSnapshotChanged( start, end );
+    publishSet();
+}
+
+//
+// Reserves the next free position in the set array, or returns -1 if the set is full. Safe to call from
+// multiple threads at once.
+//
+int reserveSetSlot()
+{
+    int size = __atomic_load_n( &setSize, __ATOMIC_RELAXED );
+
+    do
+    {
+        if( size>=maxSetSize ) return -1;
+    }
+    while( !__atomic_compare_exchange_n( &setSize, &size, size+1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) );
+
+    return size;
+}
+
+//
+// For SET_AUTO, switches from SET_LINEAR to SET_HASH once the set is no longer small, by indexing the
+// current contents. Must not overlap with any other operation on the set. If the index cannot be
+// allocated the set simply stays SET_LINEAR.
+//
+void promoteSet()
+{
+    if( !setAutoPromote || setSize<SMALL_SET_THRESHOLD ) return;
+
+    setAutoPromote = 0;
+    if( hashInit( &setIndex, maxSetSize )==-1 ) return;
+
+    hashRebuild( &setIndex, set, setSize );
+
+    // Threads that see the new backend will also see the completed index.
+    __atomic_store_n( &setBackend, SET_HASH, __ATOMIC_RELEASE );
+}
+
+
+//
+// Adds a value to the set if it does not currently exist, without publishing a snapshot. Returns 1 if
+// the set changed.
+//
+int insertIntoSet( int value )
+{
+    // May change from SET_LINEAR to SET_HASH for SET_AUTO, so is read once.
+    int backend = __atomic_load_n( &setBackend, __ATOMIC_ACQUIRE ), changed = 0;
+
+    // A single atomic OR; the array is only rebuilt when next needed. Cannot overflow, as there are only
+    // maxSetSize possible values.
+    if( backend==SET_BITMAP )
+    {
+        if( !bitmapInRange( &setBits, value ) || !bitmapInsert( &setBits, value ) ) return 0;
+
+        __atomic_store_n( &setStale, 1, __ATOMIC_RELAXED );
+        return 1;
+    }
+
+    // The packed-memory array is not thread safe, but each insert is now O(log^2 n) rather than O(n).
+    if( backend==SET_SORTED )
+    {
+        #pragma omp critical
+        {
+            if( setPacked.count<maxSetSize && pmaInsert( &setPacked, value ) ) setStale = changed = 1;
+        }
+        return changed;
+    }
+
+    if( backend==SET_HASH )
+    {
+        // Cheap early exit so a full set does not keep claiming and releasing hash slots.
+        if( __atomic_load_n( &setSize, __ATOMIC_RELAXED )>=maxSetSize ) return 0;
+
+        // Only the thread that claims the value's slot goes on to add it, so no critical section is needed.
+        long slot = hashInsert( &setIndex, value );
+        if( slot==-1 ) return 0;
+
+        int index = reserveSetSlot();
+        if( index==-1 )
+        {
+            hashRelease( &setIndex, slot );
+            return 0;
+        }
+
+        set[index] = value;
+        return 1;
+    }
 
+    // The check and the insertion must be in the same critical section, otherwise two threads adding the
+    // same value can both pass the check.
+    int promoted = 0;
+
+    #pragma omp critical
+    {
+        // Another thread may have switched to the hash index while this one was waiting.
+        if( setBackend==SET_HASH )
+            promoted = 1;
+
+        // Since sets should not have duplicates, first check this value is not already in the set. Cannot
+        // exceed the maximum size.
+        else if( setSize<maxSetSize && scanFind( set, setSize, value )==-1 )
+        {
+            set[setSize] = value;
+            setSize++;
+            changed = 1;
+
+            promoteSet();
+        }
+    }
+
+    return ( promoted ? insertIntoSet( value ) : changed );
+}
 
 //
 // Add a value to the set if it does not currently exist.
 //
 void addToSet( int value )
 {
-    int should_return = 0;
+    if( !setSnapshots )
+    {
+        insertIntoSet( value );
+        return;
+    }
 
+    // Each insert publishes its own version before the next insert starts, so a version never includes a
+    // slot that has been reserved by another thread but not yet written.
+    #pragma omp critical(setSnapshot)
+    {
+        int start = setSize;
+        if( insertIntoSet( value ) ) setChanged( start, setSize );
+    }
+}
 
-    #pragma omp critical
+//
+// Add a batch of values to the set, skipping those already present and repeats within the batch. The
+// result is the same as calling addToSet() on each value in turn, but the batch is deduplicated in
+// parallel and the survivors appended at offsets from a single prefix sum, so there is one
+// synchronisation per batch rather than one per value. Call from outside any parallel region.
+//
+void addManyToSet( const int *values, int n )
+{
+    int i, t;
+
+    if( n<=0 ) return;
+
+    // No deduplication needed; the bitmap ignores repeats, and the array is rebuilt in order later.
+    if( setBackend==SET_BITMAP )
+    {
+        #pragma omp parallel for
+        for( i=0; i<n; i++ )
+            if( bitmapInRange( &setBits, values[i] ) ) bitmapInsert( &setBits, values[i] );
+
+        setStale = 1;
+        setChanged( 0, 0 );
+        return;
+    }
+
+    if( setBackend==SET_SORTED )
     {
-    // Cannot exceed the maximum size.
-    if( setSize==maxSetSize ) should_return = 1;
+        for( i=0; i<n && setPacked.count<maxSetSize; i++ ) pmaInsert( &setPacked, values[i] );
+
+        setStale = 1;
+        setChanged( 0, 0 );
+        return;
+    }
+
+    // Index the batch, recording for each distinct value the position of its first occurrence. The
+    // first-occurrence rule (rather than whichever thread won the slot) keeps the result deterministic.
+    HashIndex batch;
+    if( hashInit( &batch, n )==-1 ) return;
+
+    long numSlots = batch.mask + 1;
+    int *firstIndex = (int*) malloc( numSlots*sizeof(int) );
+    if( firstIndex==0 )
+    {
+        printf( "WARNING: Failed to allocate memory for the batch insert.\n" );
+        hashFree( &batch );
+        return;
+    }
+
+    #pragma omp parallel for
+    for( i=0; i<numSlots; i++ ) firstIndex[i] = n;
 
-    // Since sets should not have duplicates, first check this value is not already in the set.
-    for( int i=0; i<setSize; i++ )
-        if( set[i]==value )
+    #pragma omp parallel for
+    for( i=0; i<n; i++ )
+    {
+        long slot = hashInsert( &batch, values[i] );
+        if( slot==-1 ) slot = hashFind( &batch, values[i] );
+
+        // Atomic minimum; retries only while this position is still earlier than the recorded one.
+        int current = __atomic_load_n( &firstIndex[slot], __ATOMIC_RELAXED );
+        while( i<current && !__atomic_compare_exchange_n( &firstIndex[slot], &current, i, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) );
+    }
+
+    // Filter out values already in the set. The hash backend can look each one up directly; otherwise
+    // one pass over the set marks the batch slots of existing members.
+    if( setBackend!=SET_HASH )
+    {
+        #pragma omp parallel for
+        for( i=0; i<setSize; i++ )
         {
-            should_return = 1;
+            long slot = hashFind( &batch, set[i] );
+            if( slot!=-1 ) firstIndex[slot] = -1;
         }
     }
 
-    if( should_return == 1) return;
+    // Each thread counts the survivors in its own contiguous block of the batch, one prefix sum over
+    // the per-thread counts gives each block its offset, and the survivors are then written in order.
+    int base = setSize, room = maxSetSize - setSize, total = 0;
+    int maxThreads = omp_get_max_threads();
+    int *offsets = (int*) calloc( maxThreads+1, sizeof(int) );
 
-    #pragma omp critical
+    #pragma omp parallel private(i)
+    {
+        int thread = omp_get_thread_num(), numThreads = omp_get_num_threads();
+        int start = (int) ( (long) n *  thread    / numThreads );
+        int end   = (int) ( (long) n * (thread+1) / numThreads );
+        int count = 0;
+
+        for( i=start; i<end; i++ )
+        {
+            long slot = hashFind( &batch, values[i] );
+            int keep  = ( firstIndex[slot]==i );
+
+            if( keep && setBackend==SET_HASH && hashFind( &setIndex, values[i] )!=-1 ) keep = 0;
+
+            // Reuse the slot entry to pass the decision on to the write pass.
+            if( !keep && firstIndex[slot]==i ) firstIndex[slot] = -1;
+            count += keep;
+        }
+        offsets[thread+1] = count;
+
+        #pragma omp barrier
+        #pragma omp single
+        {
+            for( t=0; t<numThreads; t++ ) offsets[t+1] += offsets[t];
+            total = offsets[numThreads];
+        }
+
+        int index = base + offsets[thread];
+        for( i=start; i<end; i++ )
+        {
+            long slot = hashFind( &batch, values[i] );
+            if( firstIndex[slot]!=i ) continue;
+
+            // Cannot exceed the maximum size; later survivors are dropped, as with repeated addToSet().
+            if( index-base>=room ) break;
+
+            set[index++] = values[i];
+            if( setBackend==SET_HASH ) hashInsert( &setIndex, values[i] );
+        }
+    }
+
+    setSize = base + ( total<room ? total : room );
+
+    free( offsets );
+    free( firstIndex );
+    hashFree( &batch );
+
+    promoteSet();
+    setChanged( base, setSize );
+}
+
+//
+// Pseudo-random value number 'index' of the stream for the given seed (the SplitMix64 mixing function).
+// Depends on nothing else, so any thread can generate any part of the stream without shared state.
+//
+uint64_t randomAt( uint64_t seed, long index )
+{
+    uint64_t z = seed + (uint64_t) (index+1) * 0x9e3779b97f4a7c15ull;
+
+    z = ( z ^ (z>>30) ) * 0xbf58476d1ce4e5b9ull;
+    z = ( z ^ (z>>27) ) * 0x94d049bb133111ebull;
+
+    return z ^ (z>>31);
+}
+
+//
+// Add count pseudo-random values in the range 0 to range-1, in two phases. First each thread fills its own
+// contiguous block of a buffer from the seeded stream, with no sharing or locking; then addManyToSet()
+// deduplicates the blocks in parallel and merges them into the set, in stream order. Call from outside
+// any parallel region.
+//
+void addRandomToSet( int count, int range, unsigned int seed )
+{
+    if( count<=0 ) return;
+
+    int *values = (int*) malloc( count*sizeof(int) );
+    if( values==0 )
     {
-    	// Only reach this point if the value was not found and there is room to add to the set.
-    	set[setSize] = value;
-    	setSize++;
+        printf( "WARNING: Failed to allocate memory for the insert buffers.\n" );
+        return;
+    }
+
+    #pragma omp parallel
+    {
+        int thread = omp_get_thread_num(), numThreads = omp_get_num_threads();
+        long i, start = (long) count * thread / numThreads, end = (long) count * (thread+1) / numThreads;
+
+        for( i=start; i<end; i++ ) values[i] = (int) ( randomAt( seed, i ) % (uint64_t) range );
     }
+
+    addManyToSet( values, count );
+
+    free( values );
 }
 
+
 //
 // Remove a value from the set, if it exists, and shuffle the remaining values so the set remains contiguous.
 //
 void removeFromSet( int value )
 {
-    // int i;
+    if( setBackend==SET_BITMAP )
+    {
+        if( bitmapInRange( &setBits, value ) && bitmapErase( &setBits, value ) )
+        {
+            setStale = 1;
+            setChanged( 0, 0 );
+        }
+        return;
+    }
 
-    // Find where the index in the set corresponding to the value, if any.
-    int index = -1;
-    #pragma omp parallel for
-    for( int i=0; i<setSize; i++ )
-        if( set[i]==value )
-            index = i;
+    if( setBackend==SET_SORTED )
+    {
+        if( pmaErase( &setPacked, value ) )
+        {
+            setStale = 1;
+            setChanged( 0, 0 );
+        }
+        return;
+    }
+
+    // The hash index can rule out absent values without touching the array.
+    if( setBackend==SET_HASH && hashFind( &setIndex, value )==-1 ) return;
+
+    // Find where the index in the set corresponding to the value, if any. Each thread scans its own block
+    // with the vectorised search, and a min reduction rather than a shared write combines the results so
+    // threads cannot race. Small sets are not worth the threads.
+    int index = setSize;
+    #pragma omp parallel reduction(min:index) if( setSize>=SMALL_SET_THRESHOLD )
+    {
+        int thread = omp_get_thread_num(), numThreads = omp_get_num_threads();
+        int start = (int) ( (long) setSize *  thread    / numThreads );
+        int end   = (int) ( (long) setSize * (thread+1) / numThreads );
+
+        int found = scanFind( set+start, end-start, value );
+        if( found!=-1 ) index = start + found;
+    }
 
     // If found, 'remove'. Here, 'removal' is achieved by moving all values later in the set down by one index,
-    // and also reducing the set size by one.
-    if( index!= -1 )
+    // and also reducing the set size by one. memmove() handles the overlap, so no temporary copy is needed.
+    if( index!=setSize )
     {
-        float set_temp[setSize];
+        memmove( &set[index], &set[index+1], (setSize-index-1)*sizeof(int) );
+        setSize--;
 
-        #pragma omp parallel for
-        for ( int i=index; i<setSize; i++)
-            set_temp[i] = set[i];
+        if( setBackend==SET_HASH )
+        {
+            hashErase( &setIndex, value );
+            if( hashNeedsRebuild( &setIndex ) ) hashRebuild( &setIndex, set, setSize );
+        }
 
+        // Only the values after the removed one have moved.
+        setChanged( index, setSize );
+    }
+}
 
+
+//
+// Remove a batch of values from the set, keeping the remaining values contiguous and in order. Victims are
+// flagged in one parallel pass and the survivors compacted using a prefix sum over per-thread counts, so
+// removing k values costs O(n + k) rather than the O(n.k) of calling removeFromSet() on each. Call from
+// outside any parallel region.
+//
+void removeManyFromSet( const int *values, int k )
+{
+    int i, t;
+
+    if( k<=0 ) return;
+
+    if( setBackend==SET_BITMAP )
+    {
         #pragma omp parallel for
-        for( int i=index; i<setSize-1; i++ )
-            set[i] = set_temp[i+1];
+        for( i=0; i<k; i++ )
+            if( bitmapInRange( &setBits, values[i] ) ) bitmapErase( &setBits, values[i] );
 
-        setSize--;
+        setStale = 1;
+        setChanged( 0, 0 );
+        return;
+    }
+
+    if( setBackend==SET_SORTED )
+    {
+        for( i=0; i<k; i++ ) pmaErase( &setPacked, values[i] );
+
+        setStale = 1;
+        setChanged( 0, 0 );
+        return;
+    }
+
+    if( setSize==0 ) return;
+
+    // Index the victims so each member of the set can be checked in O(1).
+    HashIndex victims;
+    if( hashInit( &victims, k )==-1 ) return;
+
+    #pragma omp parallel for
+    for( i=0; i<k; i++ ) hashInsert( &victims, values[i] );
+
+    char *keep = (char*) malloc( setSize*sizeof(char) );
+    int  *kept = (int*)  malloc( setSize*sizeof(int)  );
+    int  *offsets = (int*) calloc( omp_get_max_threads()+1, sizeof(int) );
+    if( keep==0 || kept==0 || offsets==0 )
+    {
+        printf( "WARNING: Failed to allocate memory for the batch removal.\n" );
+        free( keep ); free( kept ); free( offsets );
+        hashFree( &victims );
+        return;
     }
+
+    int total = 0;
+
+    #pragma omp parallel private(i)
+    {
+        int thread = omp_get_thread_num(), numThreads = omp_get_num_threads();
+        int start = (int) ( (long) setSize *  thread    / numThreads );
+        int end   = (int) ( (long) setSize * (thread+1) / numThreads );
+        int count = 0;
+
+        for( i=start; i<end; i++ )
+        {
+            keep[i] = ( hashFind( &victims, set[i] )==-1 );
+            count += keep[i];
+        }
+        offsets[thread+1] = count;
+
+        #pragma omp barrier
+        #pragma omp single
+        {
+            for( t=0; t<numThreads; t++ ) offsets[t+1] += offsets[t];
+            total = offsets[numThreads];
+        }
+
+        int index = offsets[thread];
+        for( i=start; i<end; i++ )
+            if( keep[i] ) kept[index++] = set[i];
+
+        // Everyone must finish reading set[] before it is overwritten.
+        #pragma omp barrier
+        #pragma omp for
+        for( i=0; i<total; i++ ) set[i] = kept[i];
+    }
+
+    setSize = total;
+
+    if( setBackend==SET_HASH )
+    {
+        for( i=0; i<k; i++ ) hashErase( &setIndex, values[i] );
+        if( hashNeedsRebuild( &setIndex ) ) hashRebuild( &setIndex, set, setSize );
+    }
+
+    free( keep );
+    free( kept );
+    free( offsets );
+    hashFree( &victims );
+
+    // The values before the first victim are unchanged, so their chunks are still shared.
+    setChanged( 0, setSize );
 }
 
 
@@ -109,24 +686,74 @@ void removeFromSet( int value )
 //
 void sortSet()
 {
-    for( int i = 0; i < setSize - 1; i++)
+    // These backends already list the set in increasing order.
+    if( setBackend==SET_BITMAP || setBackend==SET_SORTED )
     {
-        // Update odd and evens at different times.
-        // See lecture 5 redBlack code
-        #pragma omp parallel for
-        for( int j = i % 2; j < setSize - 1; j+=2)
-        {
-            if( set[j] > set[j+1] )
-            {
-                int temp = set[j];
-                set[j] = set[j+1];
-                set[j+1] = temp;
-            }
-        }
+        syncSet();
+        return;
     }
+
+    // Tasked merge sort (cwk1_sort.h); odd-even transposition needed O(n^2) work and a barrier per phase.
+    parallelSort( set, setSize );
+    setChanged( 0, setSize );
 }
 
 
+//
+// As printSet(), but prints the latest snapshot using the given reader slot (cwk1_snapshot.h), so it
+// can run on a reporting thread while others are still changing the set. Falls back to printSet() if
+// snapshots have not been enabled.
+//
+void printSetSnapshot( int reader )
+{
+    const SetVersion *version = acquireSnapshot( reader );
+    int i;
+
+    if( version==0 )
+    {
+        releaseSnapshot( reader );
+        printSet();
+        return;
+    }
+
+    if( version->size==0 )
+        printf( "Set is empty.\n" );
+    else if( version->size==1 )
+        printf( "Set has one entry: %i\n", snapshotValue( version, 0 ) );
+    else
+    {
+        printf( "Set has %i entries:\n", version->size );
+        for( i=0; i<version->size; i++ ) printf( "%i\t", snapshotValue( version, i ) );
+        printf( "\n" );
+    }
+
+    releaseSnapshot( reader );
+}
+
+
+#ifdef BENCH
+//
+// The benchmark harness has its own main().
+//
+#include "cwk1_bench.h"
+#elif defined(SNAPSHOT_TEST)
+//
+// The concurrent snapshot test also has its own main().
+//
+#include "cwk1_snapshot_test.h"
+#else
+//
+// Prints the set for main(), from the latest snapshot if they are enabled.
+//
+void reportSet()
+{
+#ifdef SNAPSHOT_READS
+    printSetSnapshot( 0 );
+#else
+    printSet();
+#endif
+}
+
 //
 // Main.
 //
@@ -158,40 +785,53 @@ int main( int argc, char **argv )
 
     // Initialise the set. Returns -1 if could not allocate memory.
     if( initSet(maxSetSize)==-1 ) return EXIT_FAILURE;
+    if( initSetBackend(SET_BACKEND)==-1 ) return EXIT_FAILURE;
+#ifdef SNAPSHOT_READS
+    if( enableSetSnapshots()==-1 ) return EXIT_FAILURE;
+#endif
 
-    // Seed the psuedo-random number generator to the current time.
-    srand( time(NULL) );
+    // Seed the psuedo-random number generator to the current time, unless a fixed seed was given.
+    unsigned int seed = ( RANDOM_SEED ? RANDOM_SEED : time(NULL) );
+    srand( seed );
 
     // Add random numbers in the range 0 to maxSetSize-1 inclusive.
 
     // ###### THIS IS WHERE QUESTION 1 HAPPENS ######
+#ifdef BUFFERED_INSERT
+    addRandomToSet( initSetSize, maxSetSize, seed );
+#else
     #pragma omp parallel for
     for( i=0; i<initSetSize; i++ )
     {
         addToSet( rand()%maxSetSize );
     }
+#endif
+    syncSet();
 
     printf( "Attempted to add %i random values. Current state of set:\n", initSetSize );
-    printSet();
+    reportSet();
 
     // Remove values from the set; random values from the same range as they were added.
     for( i=0; i<numToRemove; i++ )
         removeFromSet( rand()%maxSetSize );
+    syncSet();
 
     printf( "\nRemoved up to %i random values if present. Current state of set:\n", numToRemove );
-    printSet();
+    reportSet();
 
     // Finally, sort the set in increasing order.
     if (sortYesNo==1 )
     {
         sortSet();
         printf( "\nCalled sortSet(). Current state of set:\n" );
-        printSet();
+        reportSet();
     }
 
     // You MUST call this function just before finishing - do NOT remove, or change the definition of destroySet(),
     // as it will be changed with a different version for assessment.
+    destroySetBackend();
     destroySet();
 
     return EXIT_SUCCESS;
 }
+#endif
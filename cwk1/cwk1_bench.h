@@ -0,0 +1,294 @@
+//
+// Benchmark harness for the set operations in cwk1.c. Replaces main() when compiled with -DBENCH (see the
+// 'bench' target in the makefile).
+//
+// Sweeps the set size in powers of 10, the duplicate ratio of the inserted values and the number of
+// threads, for every backend. Each phase is timed with omp_get_wtime() and written as one line of CSV to
+// stdout; nothing is printed by the set routines themselves. The speed-up is relative to one thread for
+// the same backend, size, duplicate ratio and phase.
+//
+// The snapshot phases add the values in batches with snapshots enabled while one extra thread keeps
+// reading the latest version (cwk1_snapshot.h). 'snapshotAdd' counts the values added and 'snapshotRead'
+// the versions the reader iterated over, in the same time.
+//
+
+
+//
+// Parameters.
+//
+
+// Default range of set sizes, overridden by the two optional command line arguments.
+#define BENCH_MIN_SIZE 1000
+#define BENCH_MAX_SIZE 100000000
+
+// SET_LINEAR is O(n^2) to fill, so is only run up to this size.
+#define BENCH_MAX_LINEAR_SIZE 10000
+
+// Removals with removeFromSet() shift the array each time, so are capped at this many per run.
+#define BENCH_MAX_SINGLE_REMOVES 100
+
+// Every snapshot is a full copy of the set, so the snapshot phases are only run up to this size.
+#define BENCH_MAX_SNAPSHOT_SIZE 10000000
+
+// Number of batches the values are added in for the snapshot phases; each batch publishes one version.
+#define BENCH_SNAPSHOT_BATCHES 100
+
+// Seed for generating the inserted values.
+#define BENCH_SEED 12345
+
+// Duplicate ratios to sweep: the approximate fraction of inserted values that repeat an earlier one.
+const double benchDupRatios[] = { 0.0, 0.5, 0.9 };
+#define BENCH_NUM_DUP_RATIOS 3
+
+// Phases timed for each configuration.
+#define BENCH_ADD           0
+#define BENCH_REMOVE        1
+#define BENCH_REMOVE_MANY   2
+#define BENCH_SORT          3
+#define BENCH_ADD_MANY      4
+#define BENCH_SNAPSHOT_ADD  5
+#define BENCH_SNAPSHOT_READ 6
+#define BENCH_NUM_PHASES    7
+
+const char *benchPhaseNames [] = { "add", "remove", "removeMany", "sort", "addMany", "snapshotAdd", "snapshotRead" };
+const char *benchBackendNames[] = { "linear", "hash", "bitmap", "sorted", "auto" };
+#define BENCH_NUM_BACKENDS 5
+
+
+//
+// Fills values[0..n-1] with values in the range 0 to n-1. Value i is distinct from all earlier ones, except
+// for a fraction dupRatio chosen to repeat the value at a random earlier position. Multiplying by a prime
+// larger than n is a permutation modulo n, which scatters the distinct values over the range.
+//
+void benchValues( int *values, int n, double dupRatio )
+{
+    long i;
+
+    #pragma omp parallel for
+    for( i=0; i<n; i++ )
+    {
+        long k = i;
+        if( i>0 && randomAt( BENCH_SEED, i )%1000 < (uint64_t) (dupRatio*1000) )
+            k = randomAt( BENCH_SEED+1, i ) % i;
+
+        values[i] = (int) ( (uint64_t) k * 2654435761ull % (uint64_t) n );
+    }
+}
+
+//
+// Writes one line of CSV.
+//
+void benchReport( int backend, int n, int threads, double dupRatio, int phase, long ops, double seconds, double serialSeconds )
+{
+    printf( "%s,%d,%d,%.2f,%s,%ld,%.6f,%.6g,%.3f\n",
+            benchBackendNames[backend], n, threads, dupRatio, benchPhaseNames[phase], ops, seconds,
+            ( seconds>0.0 ? ops/seconds : 0.0 ), ( seconds>0.0 ? serialSeconds/seconds : 0.0 ) );
+    fflush( stdout );
+}
+
+//
+// Adds values[0..n-1] to the empty set in BENCH_SNAPSHOT_BATCHES batches with addManyToSet(), publishing a
+// snapshot after each, while one more thread repeatedly acquires the latest snapshot and reads every value
+// in it. Nested parallelism is enabled so the batches still use all the threads. Writes the time taken to
+// *seconds and returns the number of snapshots read, or -1 if the reader saw an inconsistent one (the set
+// only grows, so each version must be no smaller than the last, and every value must lie in 0 to n-1) or
+// snapshots could not be enabled.
+//
+long benchSnapshots( int n, const int *values, double *seconds )
+{
+    int batchSize = ( n+BENCH_SNAPSHOT_BATCHES-1 ) / BENCH_SNAPSHOT_BATCHES, done = 0, errors = 0;
+    long reads = 0;
+
+    if( enableSetSnapshots()==-1 ) return -1;
+
+    int maxLevels = omp_get_max_active_levels();
+    omp_set_max_active_levels( 2 );
+
+    double start = omp_get_wtime();
+
+    #pragma omp parallel num_threads(2)
+    {
+        if( omp_get_thread_num()==0 )
+        {
+            int first;
+            for( first=0; first<n; first+=batchSize )
+                addManyToSet( values+first, ( n-first<batchSize ? n-first : batchSize ) );
+
+            __atomic_store_n( &done, 1, __ATOMIC_RELEASE );
+        }
+        else
+        {
+            int i, lastSize = 0;
+
+            while( !__atomic_load_n( &done, __ATOMIC_ACQUIRE ) )
+            {
+                const SetVersion *version = acquireSnapshot( 0 );
+
+                if( version->size<lastSize ) errors++;
+                lastSize = version->size;
+
+                for( i=0; i<version->size; i++ )
+                {
+                    int value = snapshotValue( version, i );
+                    if( value<0 || value>=n ) errors++;
+                }
+
+                releaseSnapshot( 0 );
+                reads++;
+            }
+        }
+    }
+
+    *seconds = omp_get_wtime() - start;
+    omp_set_max_active_levels( maxLevels );
+
+    return ( errors ? -1 : reads );
+}
+
+//
+// Times each phase for one configuration, writing the times to seconds[], the number of values sorted to
+// sortSize and the number of snapshots read to snapshotReads.
+//
+int benchRun( int backend, int n, const int *values, const int *victims, int numVictims, double *seconds, long *sortSize,
+              long *snapshotReads )
+{
+    int i, numSingle = ( numVictims<BENCH_MAX_SINGLE_REMOVES ? numVictims : BENCH_MAX_SINGLE_REMOVES );
+    double start;
+
+    if( initSet(n)==-1 || initSetBackend(backend)==-1 ) return -1;
+
+    // Values are added one at a time from a parallel loop, as in main() without BUFFERED_INSERT.
+    start = omp_get_wtime();
+    #pragma omp parallel for
+    for( i=0; i<n; i++ ) addToSet( values[i] );
+    syncSet();
+    seconds[BENCH_ADD] = omp_get_wtime() - start;
+
+    start = omp_get_wtime();
+    for( i=0; i<numSingle; i++ ) removeFromSet( victims[i] );
+    syncSet();
+    seconds[BENCH_REMOVE] = omp_get_wtime() - start;
+
+    start = omp_get_wtime();
+    removeManyFromSet( victims+numSingle, numVictims-numSingle );
+    syncSet();
+    seconds[BENCH_REMOVE_MANY] = omp_get_wtime() - start;
+
+    *sortSize = setSize;
+    start = omp_get_wtime();
+    sortSet();
+    seconds[BENCH_SORT] = omp_get_wtime() - start;
+
+    destroySetBackend();
+    destroySet();
+
+    // The batch insert starts again from an empty set.
+    if( initSet(n)==-1 || initSetBackend(backend)==-1 ) return -1;
+
+    start = omp_get_wtime();
+    addManyToSet( values, n );
+    syncSet();
+    seconds[BENCH_ADD_MANY] = omp_get_wtime() - start;
+
+    destroySetBackend();
+    destroySet();
+
+    if( n>BENCH_MAX_SNAPSHOT_SIZE ) return 0;
+
+    // And again with a concurrent reader.
+    if( initSet(n)==-1 || initSetBackend(backend)==-1 ) return -1;
+
+    *snapshotReads = benchSnapshots( n, values, &seconds[BENCH_SNAPSHOT_ADD] );
+    seconds[BENCH_SNAPSHOT_READ] = seconds[BENCH_SNAPSHOT_ADD];
+
+    destroySetBackend();
+    destroySet();
+
+    if( *snapshotReads==-1 )
+    {
+        printf( "WARNING: A snapshot reader saw an inconsistent version of the set.\n" );
+        return -1;
+    }
+
+    return 0;
+}
+
+
+//
+// Main for the benchmark.
+//
+int main( int argc, char **argv )
+{
+    int minSize = BENCH_MIN_SIZE, maxSize = BENCH_MAX_SIZE;
+
+    if( argc==3 )
+    {
+        minSize = atoi(argv[1]);
+        maxSize = atoi(argv[2]);
+    }
+    if( (argc!=1 && argc!=3) || minSize<=0 || maxSize<minSize )
+    {
+        printf( "Usage: %s [minimum set size] [maximum set size]; the sizes step up by factors of 10.\n", argv[0] );
+        return EXIT_FAILURE;
+    }
+
+    int maxThreads = omp_get_max_threads();
+
+    printf( "backend,size,threads,dup_ratio,phase,ops,seconds,ops_per_s,speedup\n" );
+
+    long n;
+    for( n=minSize; n<=maxSize; n*=10 )
+    {
+        int *values  = (int*) malloc( n*sizeof(int) );
+        int *victims = (int*) malloc( (n/10+1)*sizeof(int) );
+        if( values==0 || victims==0 )
+        {
+            printf( "WARNING: Failed to allocate memory for size %ld; stopping.\n", n );
+            free( values );
+            free( victims );
+            break;
+        }
+
+        // Remove a tenth of the range, drawn from the whole range so some victims are not members.
+        int i, d, numVictims = n/10;
+        for( i=0; i<numVictims; i++ ) victims[i] = (int) ( randomAt( BENCH_SEED+2, i ) % n );
+
+        for( d=0; d<BENCH_NUM_DUP_RATIOS; d++ )
+        {
+            benchValues( values, n, benchDupRatios[d] );
+
+            int backend;
+            for( backend=0; backend<BENCH_NUM_BACKENDS; backend++ )
+            {
+                if( backend==SET_LINEAR && n>BENCH_MAX_LINEAR_SIZE ) continue;
+
+                double serialSeconds[BENCH_NUM_PHASES], seconds[BENCH_NUM_PHASES];
+                long ops[BENCH_NUM_PHASES] = { n, ( numVictims<BENCH_MAX_SINGLE_REMOVES ? numVictims : BENCH_MAX_SINGLE_REMOVES ), 0, 0, n, n, 0 };
+                ops[BENCH_REMOVE_MANY] = numVictims - ops[BENCH_REMOVE];
+
+                // Threads double up to the maximum, which is always included.
+                int threads, phase;
+                for( threads=1; threads<=maxThreads; threads=( threads<maxThreads && 2*threads>maxThreads ? maxThreads : 2*threads ) )
+                {
+                    omp_set_num_threads( threads );
+                    if( benchRun( backend, n, values, victims, numVictims, seconds, &ops[BENCH_SORT], &ops[BENCH_SNAPSHOT_READ] )==-1 ) break;
+
+                    if( threads==1 )
+                        for( phase=0; phase<BENCH_NUM_PHASES; phase++ ) serialSeconds[phase] = seconds[phase];
+
+                    // The snapshot phases are skipped for large sets.
+                    int numPhases = ( n>BENCH_MAX_SNAPSHOT_SIZE ? BENCH_SNAPSHOT_ADD : BENCH_NUM_PHASES );
+                    for( phase=0; phase<numPhases; phase++ )
+                        benchReport( backend, n, threads, benchDupRatios[d], phase, ops[phase], seconds[phase], serialSeconds[phase] );
+                }
+            }
+        }
+
+        free( values );
+        free( victims );
+    }
+
+    omp_set_num_threads( maxThreads );
+
+    return EXIT_SUCCESS;
+}
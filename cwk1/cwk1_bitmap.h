@@ -0,0 +1,113 @@
+//
+// Dense bitmap for sets whose values all lie in the range 0 to maxValue-1.
+//
+// One bit per possible value, packed into 64-bit words. Insertion and removal are a single atomic
+// fetch-or / fetch-and on one word, so any number of threads may update the bitmap at the same time.
+// The size and the ordered list of members are recovered by scanning whole words with popcount.
+//
+
+#include <stdint.h>
+
+
+typedef struct
+{
+    uint64_t *words;
+    long numWords;
+    int maxValue;           // Values must lie in the range 0 to maxValue-1.
+} Bitmap;
+
+
+// Initialises an empty bitmap for values 0 to maxValue-1. Returns 0 if okay, -1 if there was an error.
+int bitmapInit( Bitmap *b, int maxValue )
+{
+    b->maxValue = maxValue;
+    b->numWords = ( (long) maxValue + 63 ) / 64;
+    b->words    = (uint64_t*) calloc( b->numWords, sizeof(uint64_t) );
+
+    if( b->words != 0 ) return 0;
+
+    printf( "WARNING: Failed to allocate memory for the bitmap.\n" );
+    return -1;
+}
+
+// Deletes all resources dedicated to the bitmap.
+void bitmapFree( Bitmap *b )
+{
+    free( b->words );
+    b->words = 0;
+}
+
+// Returns 1 if the value can be stored in the bitmap, 0 otherwise.
+int bitmapInRange( const Bitmap *b, int value )
+{
+    return value>=0 && value<b->maxValue;
+}
+
+// Sets the bit for an in-range value. Returns 1 if it was not already set.
+int bitmapInsert( Bitmap *b, int value )
+{
+    uint64_t bit = 1ull << (value&63);
+    return ( __atomic_fetch_or( &b->words[value>>6], bit, __ATOMIC_RELAXED ) & bit ) == 0;
+}
+
+// Clears the bit for an in-range value. Returns 1 if it was set.
+int bitmapErase( Bitmap *b, int value )
+{
+    uint64_t bit = 1ull << (value&63);
+    return ( __atomic_fetch_and( &b->words[value>>6], ~bit, __ATOMIC_RELAXED ) & bit ) != 0;
+}
+
+// Returns 1 if the bit for an in-range value is set.
+int bitmapContains( const Bitmap *b, int value )
+{
+    return ( __atomic_load_n( &b->words[value>>6], __ATOMIC_RELAXED ) >> (value&63) ) & 1;
+}
+
+// Writes the members in increasing order to out[], which must have room for all of them, and returns
+// how many there were. Each thread popcounts a contiguous block of words, a prefix sum over the counts
+// gives each block its offset, and the blocks are then expanded in parallel. Exits if the offsets cannot be
+// allocated, as the set would otherwise be left without its members.
+int bitmapMaterialise( const Bitmap *b, int *out )
+{
+    int t, total = 0;
+    int *offsets = (int*) calloc( omp_get_max_threads()+1, sizeof(int) );
+
+    if( offsets==0 )
+    {
+        printf( "WARNING: Failed to allocate memory for listing the bitmap.\n" );
+        exit( EXIT_FAILURE );
+    }
+
+    #pragma omp parallel
+    {
+        int thread = omp_get_thread_num(), numThreads = omp_get_num_threads();
+        long w, start = b->numWords * thread / numThreads, end = b->numWords * (thread+1) / numThreads;
+        int count = 0;
+
+        for( w=start; w<end; w++ ) count += __builtin_popcountll( b->words[w] );
+        offsets[thread+1] = count;
+
+        #pragma omp barrier
+        #pragma omp single
+        {
+            for( t=0; t<numThreads; t++ ) offsets[t+1] += offsets[t];
+            total = offsets[numThreads];
+        }
+
+        int index = offsets[thread];
+        for( w=start; w<end; w++ )
+        {
+            uint64_t word = b->words[w];
+
+            // Peel off the lowest set bit each time, so only the members are visited.
+            while( word )
+            {
+                out[index++] = (int) ( 64*w + __builtin_ctzll(word) );
+                word &= word - 1;
+            }
+        }
+    }
+
+    free( offsets );
+    return total;
+}
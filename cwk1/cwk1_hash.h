@@ -0,0 +1,151 @@
+//
+// Open-addressing hash index for the set in cwk1.c.
+//
+// The index holds the same values as set[0..setSize-1], so membership can be checked in O(1) rather than
+// by scanning the array. Slots are claimed with an atomic compare-and-swap, so any number of threads may
+// insert and find at the same time without a critical section. Erasing and rebuilding must not overlap
+// with any other operation.
+//
+
+#include <stdint.h>
+#include <string.h>
+
+
+//
+// Each slot packs a state into the upper 32 bits and the value into the lower 32, so every int can be
+// stored and claiming a slot is a single 64-bit compare-and-swap.
+//
+#define HASH_EMPTY     0ull
+#define HASH_USED      (1ull<<32)
+#define HASH_TOMBSTONE (2ull<<32)
+
+typedef struct
+{
+    uint64_t *slots;
+    long mask;              // The number of slots minus one; the number of slots is always a power of 2.
+    long tombstones;        // Erased slots that still lengthen the probe sequences.
+} HashIndex;
+
+
+// Scrambles the bits of the value (the MurmurHash3 finaliser) so nearby values spread over the table.
+uint32_t hashValue( int value )
+{
+    uint32_t h = (uint32_t) value;
+
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+
+    return h;
+}
+
+// Initialises an empty index with room for maxValues values at a load factor of at most one half.
+// Returns 0 if okay, -1 if there was an allocation error.
+int hashInit( HashIndex *h, int maxValues )
+{
+    long numSlots = 16;
+    while( numSlots < 2L*maxValues ) numSlots *= 2;
+
+    h->slots      = (uint64_t*) calloc( numSlots, sizeof(uint64_t) );
+    h->mask       = numSlots - 1;
+    h->tombstones = 0;
+
+    if( h->slots != 0 ) return 0;
+
+    printf( "WARNING: Failed to allocate memory for the hash index.\n" );
+    return -1;
+}
+
+// Deletes all resources dedicated to the index.
+void hashFree( HashIndex *h )
+{
+    free( h->slots );
+    h->slots = 0;
+}
+
+// Inserts the value if it is not already present. Returns the slot claimed by this call, or -1 if the
+// value was already in the index (possibly inserted by another thread at the same time).
+long hashInsert( HashIndex *h, int value )
+{
+    uint64_t key = HASH_USED | (uint32_t) value;
+    long probe, pos = hashValue(value) & h->mask;
+
+    for( probe=0; probe<=h->mask; probe++ )
+    {
+        uint64_t current = __atomic_load_n( &h->slots[pos], __ATOMIC_ACQUIRE );
+
+        if( current==key ) return -1;
+
+        if( current==HASH_EMPTY )
+        {
+            if( __atomic_compare_exchange_n( &h->slots[pos], &current, key, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ) )
+                return pos;
+
+            // Lost the race for this slot; 'current' now holds whatever the other thread wrote.
+            if( current==key ) return -1;
+        }
+
+        pos = (pos+1) & h->mask;
+    }
+
+    return -1;
+}
+
+// Returns the slot holding the value, or -1 if it is not in the index. May overlap with hashInsert().
+long hashFind( const HashIndex *h, int value )
+{
+    uint64_t key = HASH_USED | (uint32_t) value;
+    long probe, pos = hashValue(value) & h->mask;
+
+    for( probe=0; probe<=h->mask; probe++ )
+    {
+        uint64_t current = __atomic_load_n( &h->slots[pos], __ATOMIC_ACQUIRE );
+
+        if( current==key        ) return pos;
+        if( current==HASH_EMPTY ) return -1;
+
+        pos = (pos+1) & h->mask;
+    }
+
+    return -1;
+}
+
+// Marks a slot returned by hashInsert() or hashFind() as removed. Tombstones keep later probe sequences
+// intact; they are only cleared by hashRebuild().
+void hashRelease( HashIndex *h, long slot )
+{
+    __atomic_store_n( &h->slots[slot], HASH_TOMBSTONE, __ATOMIC_RELEASE );
+    __atomic_fetch_add( &h->tombstones, 1, __ATOMIC_RELAXED );
+}
+
+// Removes the value from the index. Returns 1 if it was present, 0 otherwise.
+int hashErase( HashIndex *h, int value )
+{
+    long slot = hashFind( h, value );
+    if( slot==-1 ) return 0;
+
+    hashRelease( h, slot );
+    return 1;
+}
+
+// Returns 1 if erased slots now make up more than a quarter of the table, when probe sequences start to
+// suffer and the index should be rebuilt.
+int hashNeedsRebuild( const HashIndex *h )
+{
+    return h->tombstones > (h->mask+1)/4;
+}
+
+// Clears the index and re-inserts the n given values (assumed distinct) in parallel.
+void hashRebuild( HashIndex *h, const int *values, int n )
+{
+    int i;
+
+    memset( h->slots, 0, (h->mask+1)*sizeof(uint64_t) );
+    h->tombstones = 0;
+
+    #pragma omp parallel for
+    for( i=0; i<n; i++ )
+        hashInsert( h, values[i] );
+}
@@ -0,0 +1,236 @@
+//
+// Packed-memory array: a sorted array with gaps, for sets kept in increasing order.
+//
+// Values are stored in order across an array about twice the maximum size, with the free slots spread
+// between them. An insert usually finds a gap next to its position; otherwise the smallest enclosing
+// window (a power-of-two run of leaf segments) that is still sparse enough is re-spread evenly, which
+// keeps the cost of shifting amortised O(log^2 n). Every slot, used or not, holds a key and the keys never
+// decrease, so membership is a single branchless binary search over the whole array. Not thread safe.
+//
+
+#include <limits.h>
+
+
+typedef struct
+{
+    int  *keys;             // Non-decreasing over all slots; gaps hold a copy of an earlier key.
+    char *used;             // 1 for slots that hold a member, 0 for gaps.
+    long capacity;          // Total number of slots; a power of 2.
+    long segmentSize;       // Slots per leaf segment; a power of 2 of about log2(capacity).
+    int  height;            // Levels of windows above the leaf segments.
+    long count;             // Number of members.
+} PackedArray;
+
+
+// Initialises an empty array for up to maxValues values. Returns 0 if okay, -1 if there was an error.
+int pmaInit( PackedArray *a, int maxValues )
+{
+    long i;
+
+    a->capacity = 16;
+    while( a->capacity < 2L*maxValues ) a->capacity *= 2;
+
+    a->segmentSize = 8;
+    while( (1L<<a->segmentSize) < a->capacity ) a->segmentSize *= 2;
+    if( a->segmentSize > a->capacity ) a->segmentSize = a->capacity;
+
+    a->height = 0;
+    while( (a->segmentSize<<a->height) < a->capacity ) a->height++;
+
+    a->count = 0;
+    a->keys  = (int* ) malloc( a->capacity*sizeof(int ) );
+    a->used  = (char*) calloc( a->capacity, sizeof(char) );
+
+    if( a->keys==0 || a->used==0 )
+    {
+        printf( "WARNING: Failed to allocate memory for the packed-memory array.\n" );
+        free( a->keys );
+        free( a->used );
+        return -1;
+    }
+
+    for( i=0; i<a->capacity; i++ ) a->keys[i] = INT_MIN;
+
+    return 0;
+}
+
+// Deletes all resources dedicated to the array.
+void pmaFree( PackedArray *a )
+{
+    free( a->keys );
+    free( a->used );
+    a->keys = 0;
+    a->used = 0;
+}
+
+// Returns the first slot whose key is not less than the value, or the capacity if there is none. The
+// loop always runs log2(capacity) times and the comparison compiles to a conditional move.
+long pmaLowerBound( const PackedArray *a, int value )
+{
+    const int *base = a->keys;
+    long n = a->capacity;
+
+    while( n>1 )
+    {
+        long half = n/2;
+        base = ( base[half]<value ? base+half : base );
+        n -= half;
+    }
+
+    return ( base - a->keys ) + ( *base<value );
+}
+
+// Returns the slot holding the value, or -1 if it is not a member. A member always sits at its lower
+// bound, as every earlier slot (gap or not) holds a smaller key.
+long pmaFind( const PackedArray *a, int value )
+{
+    long pos = pmaLowerBound( a, value );
+
+    if( pos<a->capacity && a->used[pos] && a->keys[pos]==value ) return pos;
+
+    return -1;
+}
+
+// Re-spreads the members of the window [start,start+size) evenly, with the value inserted in order. The
+// caller ensures the value belongs inside the window and that the window has room for it. Exits if the
+// scratch copy cannot be allocated, as the array cannot be left half re-spread.
+void pmaRedistribute( PackedArray *a, long start, long size, int value )
+{
+    long i, j, m = 0;
+    int *values = (int*) malloc( (size+1)*sizeof(int) );
+    int inserted = 0;
+
+    if( values==0 )
+    {
+        printf( "WARNING: Failed to allocate memory for re-spreading the packed-memory array.\n" );
+        exit( EXIT_FAILURE );
+    }
+
+    for( i=start; i<start+size; i++ )
+        if( a->used[i] )
+        {
+            if( !inserted && value<a->keys[i] )
+            {
+                values[m++] = value;
+                inserted = 1;
+            }
+            values[m++] = a->keys[i];
+        }
+    if( !inserted ) values[m++] = value;
+
+    // Member j goes to slot start + floor(j*size/m); each gap copies the member before it.
+    for( i=start, j=0; i<start+size; i++ )
+    {
+        long target = ( j<m ? start + j*size/m : start+size );
+
+        if( i==target )
+        {
+            a->keys[i] = values[j++];
+            a->used[i] = 1;
+        }
+        else
+        {
+            a->keys[i] = a->keys[i-1];
+            a->used[i] = 0;
+        }
+    }
+
+    free( values );
+}
+
+// Inserts the value if it is not already a member. Returns 1 if it was inserted.
+int pmaInsert( PackedArray *a, int value )
+{
+    long pos = pmaLowerBound( a, value );
+
+    if( pos<a->capacity && a->used[pos] && a->keys[pos]==value ) return 0;
+
+    // A gap at the lower bound, or just before it, can take the value without moving anything else.
+    if( pos<a->capacity && !a->used[pos] )
+    {
+        a->keys[pos] = value;
+        a->used[pos] = 1;
+        a->count++;
+        return 1;
+    }
+    if( pos>0 && !a->used[pos-1] )
+    {
+        a->keys[pos-1] = value;
+        a->used[pos-1] = 1;
+        a->count++;
+        return 1;
+    }
+
+    // Otherwise grow the window around the position until its density, counting the new value, is within
+    // the threshold for its level; thresholds fall from 1 at the leaves to 1/2 at the root.
+    long leaf = ( pos<a->capacity ? pos : a->capacity-1 );
+    long size = a->segmentSize;
+    int level;
+
+    for( level=0; level<=a->height; level++, size*=2 )
+    {
+        long i, start = leaf & ~(size-1), numUsed = 1;
+        for( i=start; i<start+size; i++ ) numUsed += a->used[i];
+
+        double threshold = ( a->height==0 ? 1.0 : 1.0 - 0.5*level/a->height );
+        if( numUsed <= threshold*size || level==a->height )
+        {
+            pmaRedistribute( a, start, size, value );
+            a->count++;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Removes the value if it is a member. Returns 1 if it was removed. The slot keeps its key as a gap, which
+// preserves the ordering of the keys without moving anything.
+int pmaErase( PackedArray *a, int value )
+{
+    long pos = pmaFind( a, value );
+    if( pos==-1 ) return 0;
+
+    a->used[pos] = 0;
+    a->count--;
+    return 1;
+}
+
+// Writes the members in increasing order to out[] and returns how many there were. Same per-thread
+// count, prefix sum and write pattern as bitmapMaterialise(), and it too exits if the offsets cannot be
+// allocated.
+int pmaMaterialise( const PackedArray *a, int *out )
+{
+    int t, total = 0;
+    int *offsets = (int*) calloc( omp_get_max_threads()+1, sizeof(int) );
+
+    if( offsets==0 )
+    {
+        printf( "WARNING: Failed to allocate memory for listing the packed-memory array.\n" );
+        exit( EXIT_FAILURE );
+    }
+
+    #pragma omp parallel
+    {
+        int thread = omp_get_thread_num(), numThreads = omp_get_num_threads();
+        long i, start = a->capacity * thread / numThreads, end = a->capacity * (thread+1) / numThreads;
+        int count = 0;
+
+        for( i=start; i<end; i++ ) count += a->used[i];
+        offsets[thread+1] = count;
+
+        #pragma omp barrier
+        #pragma omp single
+        {
+            for( t=0; t<numThreads; t++ ) offsets[t+1] += offsets[t];
+            total = offsets[numThreads];
+        }
+
+        int index = offsets[thread];
+        for( i=start; i<end; i++ )
+            if( a->used[i] ) out[index++] = a->keys[i];
+    }
+
+    free( offsets );
+    return total;
+}
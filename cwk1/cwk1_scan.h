@@ -0,0 +1,114 @@
+//
+// Vectorised linear search of an int array, for small sets where a scan beats a hash lookup.
+//
+// On x86 the widest of AVX-512, AVX2 and SSE2 supported by the CPU is chosen at run time, and compares
+// 16, 8 or 4 values per instruction, stopping at the first block whose comparison mask is non-zero. Other
+// architectures use the scalar loop.
+//
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+
+// Returns the index of the first occurrence of the value in a[0..n-1], or -1 if there is none.
+int scanScalar( const int *a, int n, int value )
+{
+    int i;
+
+    for( i=0; i<n; i++ )
+        if( a[i]==value ) return i;
+
+    return -1;
+}
+
+#ifdef SCAN_X86
+
+// SSE2 is part of x86-64, so this version needs no run time check there.
+__attribute__((target("sse2")))
+int scanSSE2( const int *a, int n, int value )
+{
+    __m128i key = _mm_set1_epi32( value );
+    int i = 0;
+
+    for( ; i+8<=n; i+=8 )
+    {
+        int mask = _mm_movemask_epi8( _mm_cmpeq_epi32( _mm_loadu_si128( (const __m128i*) (a+i  ) ), key ) )
+                 | _mm_movemask_epi8( _mm_cmpeq_epi32( _mm_loadu_si128( (const __m128i*) (a+i+4) ), key ) ) << 16;
+
+        // Four mask bits per int.
+        if( mask ) return i + __builtin_ctz(mask)/4;
+    }
+
+    int rest = scanScalar( a+i, n-i, value );
+    return ( rest==-1 ? -1 : i+rest );
+}
+
+__attribute__((target("avx2")))
+int scanAVX2( const int *a, int n, int value )
+{
+    __m256i key = _mm256_set1_epi32( value );
+    int i = 0;
+
+    for( ; i+16<=n; i+=16 )
+    {
+        __m256i lo = _mm256_cmpeq_epi32( _mm256_loadu_si256( (const __m256i*) (a+i  ) ), key );
+        __m256i hi = _mm256_cmpeq_epi32( _mm256_loadu_si256( (const __m256i*) (a+i+8) ), key );
+
+        // One mask bit per int.
+        int mask = _mm256_movemask_ps( _mm256_castsi256_ps(lo) ) | _mm256_movemask_ps( _mm256_castsi256_ps(hi) ) << 8;
+        if( mask ) return i + __builtin_ctz(mask);
+    }
+
+    int rest = scanScalar( a+i, n-i, value );
+    return ( rest==-1 ? -1 : i+rest );
+}
+
+__attribute__((target("avx512f")))
+int scanAVX512( const int *a, int n, int value )
+{
+    __m512i key = _mm512_set1_epi32( value );
+    int i = 0;
+
+    for( ; i+16<=n; i+=16 )
+    {
+        __mmask16 mask = _mm512_cmpeq_epi32_mask( _mm512_loadu_si512( (const void*) (a+i) ), key );
+        if( mask ) return i + __builtin_ctz(mask);
+    }
+
+    // The tail is handled with a masked load, so nothing past the end of the array is read.
+    if( i<n )
+    {
+        __mmask16 valid = (__mmask16) ( (1u<<(n-i)) - 1 );
+        __mmask16 mask  = _mm512_mask_cmpeq_epi32_mask( valid, _mm512_maskz_loadu_epi32( valid, a+i ), key );
+        if( mask ) return i + __builtin_ctz(mask);
+    }
+
+    return -1;
+}
+
+#endif
+
+
+// The version selected for this CPU; chosen on first use.
+int (*scanSelected)( const int*, int, int ) = 0;
+
+// Returns the index of the first occurrence of the value in a[0..n-1], or -1 if there is none.
+int scanFind( const int *a, int n, int value )
+{
+    if( scanSelected==0 )
+    {
+        int (*best)( const int*, int, int ) = scanScalar;
+#ifdef SCAN_X86
+        __builtin_cpu_init();
+        if( __builtin_cpu_supports("sse2"   ) ) best = scanSSE2;
+        if( __builtin_cpu_supports("avx2"   ) ) best = scanAVX2;
+        if( __builtin_cpu_supports("avx512f") ) best = scanAVX512;
+#endif
+        // Every thread selects the same version, so a race here is harmless.
+        __atomic_store_n( &scanSelected, best, __ATOMIC_RELAXED );
+    }
+
+    return scanSelected( a, n, value );
+}
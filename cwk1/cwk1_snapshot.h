@@ -0,0 +1,234 @@
+//
+// Versioned, read-copy-update snapshots of an int array, so readers can iterate a consistent copy of the
+// set without locking while writers carry on changing it.
+//
+// A writer publishes a new immutable version by swapping a single pointer. Readers announce the epoch
+// they started in before loading that pointer; an old version is freed only once no reader announced an
+// epoch at or before the one in which it was replaced. Publishing must be done by one thread at a time,
+// but acquiring and releasing snapshots may happen on any number of threads at once.
+//
+// A version is a table of fixed-size chunks, shared copy-on-write with the version before it. The writer
+// marks the positions it changes with markSnapshotChanged(), and publishing copies only the marked chunks
+// (and not even those if their contents turn out to be the same), so a version after one insert costs the
+// table and one chunk rather than a copy of the whole array.
+//
+
+#include <string.h>
+
+
+//
+// Parameters.
+//
+
+// Maximum number of readers that can hold a snapshot at the same time; each uses its own slot.
+#define MAX_SNAPSHOT_READERS 64
+
+// Values per chunk of a version.
+#define SNAPSHOT_CHUNK 1024
+
+
+// A chunk is freed when the last version using it is.
+typedef struct
+{
+    int refs;                   // Number of versions using it; only changed by the writer.
+    int values[SNAPSHOT_CHUNK];
+} SnapshotChunk;
+
+typedef struct SetVersion
+{
+    SnapshotChunk **chunks;     // Value i is chunks[i/SNAPSHOT_CHUNK]->values[i%SNAPSHOT_CHUNK].
+    int numChunks;
+    int size;
+    unsigned long retiredEpoch; // Epoch in which it was replaced by a newer version.
+    struct SetVersion *next;    // Next in the list of replaced versions not yet freed.
+} SetVersion;
+
+// One slot per reader, padded to a cache line so readers do not contend. Zero when not reading.
+typedef struct
+{
+    unsigned long epoch;
+    char padding[64-sizeof(unsigned long)];
+} SnapshotReader;
+
+SetVersion *currentVersion = 0;
+SetVersion *retiredVersions = 0;
+unsigned long snapshotEpoch = 1;
+SnapshotReader snapshotReaders[MAX_SNAPSHOT_READERS];
+
+// One flag per chunk of the writer's array, set if any value in it has changed since the last publish.
+char *snapshotChanged = 0;
+int snapshotMaxChunks = 0;
+
+
+// Returns value i of a version, for i in the range 0 to version->size-1.
+int snapshotValue( const SetVersion *version, int i )
+{
+    return version->chunks[i/SNAPSHOT_CHUNK]->values[i%SNAPSHOT_CHUNK];
+}
+
+// Returns the latest version, which stays valid until releaseSnapshot() is called with the same reader
+// slot, in the range 0 to MAX_SNAPSHOT_READERS-1. Never blocks. NULL if nothing has been published.
+const SetVersion *acquireSnapshot( int reader )
+{
+    unsigned long epoch = __atomic_load_n( &snapshotEpoch, __ATOMIC_SEQ_CST );
+    __atomic_store_n( &snapshotReaders[reader].epoch, epoch, __ATOMIC_SEQ_CST );
+
+    return __atomic_load_n( &currentVersion, __ATOMIC_SEQ_CST );
+}
+
+// Ends the reader's use of its snapshot.
+void releaseSnapshot( int reader )
+{
+    __atomic_store_n( &snapshotReaders[reader].epoch, 0, __ATOMIC_RELEASE );
+}
+
+// Sets up the change flags for an array of up to maxSize values. Returns 0 if okay, -1 if there was an
+// allocation error.
+int initSnapshots( int maxSize )
+{
+    snapshotMaxChunks = maxSize/SNAPSHOT_CHUNK + 1;
+    snapshotChanged   = (char*) calloc( snapshotMaxChunks, sizeof(char) );
+
+    if( snapshotChanged!=0 ) return 0;
+
+    printf( "WARNING: Failed to allocate memory for the snapshot change flags.\n" );
+    return -1;
+}
+
+// Records that positions start to end-1 of the writer's array have changed since the last publish. Does
+// nothing if initSnapshots() has not been called.
+void markSnapshotChanged( int start, int end )
+{
+    int c;
+
+    if( snapshotChanged==0 || end<=start ) return;
+
+    for( c=start/SNAPSHOT_CHUNK; c<=(end-1)/SNAPSHOT_CHUNK; c++ ) snapshotChanged[c] = 1;
+}
+
+// Frees a version, and any of its chunks no other version uses.
+void freeVersion( SetVersion *version )
+{
+    int c;
+
+    for( c=0; c<version->numChunks; c++ )
+        if( --version->chunks[c]->refs==0 ) free( version->chunks[c] );
+
+    free( version->chunks );
+    free( version );
+}
+
+// Frees every replaced version that no current reader can still be using.
+void reclaimSnapshots()
+{
+    int r;
+    unsigned long oldest = __atomic_load_n( &snapshotEpoch, __ATOMIC_SEQ_CST );
+
+    for( r=0; r<MAX_SNAPSHOT_READERS; r++ )
+    {
+        unsigned long epoch = __atomic_load_n( &snapshotReaders[r].epoch, __ATOMIC_SEQ_CST );
+        if( epoch!=0 && epoch<oldest ) oldest = epoch;
+    }
+
+    // A reader that started in 'oldest' or later loaded the pointer after these versions were replaced.
+    SetVersion **link = &retiredVersions;
+    while( *link )
+    {
+        SetVersion *version = *link;
+
+        if( version->retiredEpoch<oldest )
+        {
+            *link = version->next;
+            freeVersion( version );
+        }
+        else
+            link = &version->next;
+    }
+}
+
+// Publishes values[0..size-1] as the latest version, where size is at most the maxSize given to
+// initSnapshots(). Chunks not marked as changed are shared with the previous version, as are marked
+// ones whose values are still the same. Returns 0 if okay, -1 if there was an allocation error, in
+// which case readers keep seeing the previous version.
+int publishSnapshot( const int *values, int size )
+{
+    int c, numChunks = ( size+SNAPSHOT_CHUNK-1 ) / SNAPSHOT_CHUNK;
+    const SetVersion *previous = currentVersion;
+
+    SetVersion *version = (SetVersion*) malloc( sizeof(SetVersion) );
+    SnapshotChunk **chunks = (SnapshotChunk**) malloc( (numChunks>0 ? numChunks : 1)*sizeof(SnapshotChunk*) );
+    if( version==0 || chunks==0 )
+    {
+        printf( "WARNING: Failed to allocate memory for a set snapshot.\n" );
+        free( version );
+        free( chunks );
+        return -1;
+    }
+
+    version->chunks    = chunks;
+    version->numChunks = 0;
+    version->size      = size;
+    version->next      = 0;
+
+    for( c=0; c<numChunks; c++ )
+    {
+        int start = c*SNAPSHOT_CHUNK, length = ( size-start<SNAPSHOT_CHUNK ? size-start : SNAPSHOT_CHUNK );
+
+        // Positions past the end of the previous version were never copied, so are always marked.
+        SnapshotChunk *same = ( previous!=0 && start+length<=previous->size ? previous->chunks[c] : 0 );
+        if( same!=0 && ( !snapshotChanged[c] || memcmp( same->values, values+start, length*sizeof(int) )==0 ) )
+        {
+            same->refs++;
+            chunks[c] = same;
+        }
+        else
+        {
+            chunks[c] = (SnapshotChunk*) malloc( sizeof(SnapshotChunk) );
+            if( chunks[c]==0 )
+            {
+                printf( "WARNING: Failed to allocate memory for a set snapshot.\n" );
+                freeVersion( version );
+                return -1;
+            }
+
+            chunks[c]->refs = 1;
+            memcpy( chunks[c]->values, values+start, length*sizeof(int) );
+        }
+
+        version->numChunks++;
+    }
+
+    memset( snapshotChanged, 0, snapshotMaxChunks*sizeof(char) );
+
+    SetVersion *old = __atomic_exchange_n( &currentVersion, version, __ATOMIC_SEQ_CST );
+    if( old )
+    {
+        old->retiredEpoch = __atomic_fetch_add( &snapshotEpoch, 1, __ATOMIC_SEQ_CST );
+        old->next = retiredVersions;
+        retiredVersions = old;
+    }
+
+    reclaimSnapshots();
+    return 0;
+}
+
+// Frees every version, including the current one, and the change flags. No reader may hold a snapshot.
+void destroySnapshots()
+{
+    SetVersion *version = __atomic_exchange_n( &currentVersion, (SetVersion*) 0, __ATOMIC_SEQ_CST );
+    if( version )
+    {
+        version->next = retiredVersions;
+        retiredVersions = version;
+    }
+
+    while( retiredVersions )
+    {
+        version = retiredVersions;
+        retiredVersions = version->next;
+        freeVersion( version );
+    }
+
+    free( snapshotChanged );
+    snapshotChanged = 0;
+}
@@ -0,0 +1,182 @@
+//
+// Concurrent test of the set snapshots (cwk1_snapshot.h). Replaces main() when compiled with
+// -DSNAPSHOT_TEST (see the 'snapshots' target in the makefile).
+//
+// For every backend, writer threads add values one at a time with addToSet(), and then one writer removes
+// them one at a time with removeFromSet(), while reader threads keep taking snapshots. Every snapshot must
+// hold distinct values in range; while the set grows each one must contain every value of the one the
+// same reader saw before, and while it shrinks be contained in it. Once the writers have finished, the
+// latest snapshot must be the set itself. Prints one line per backend and phase, and exits with
+// EXIT_FAILURE if any check failed.
+//
+
+
+//
+// Parameters.
+//
+
+// Maximum set size, and the range of the values added.
+#define SNAPSHOT_TEST_SIZE 10000
+
+// Values added by the writers, and then removed by the single writer.
+#define SNAPSHOT_TEST_ADDS    20000
+#define SNAPSHOT_TEST_REMOVES 5000
+
+// Threads in each role. The readers use snapshot slots 0 to SNAPSHOT_TEST_READERS-1.
+#define SNAPSHOT_TEST_WRITERS 2
+#define SNAPSHOT_TEST_READERS 2
+
+// Seed for the values added and removed.
+#define SNAPSHOT_TEST_SEED 54321
+
+const char *snapshotTestBackends[] = { "linear", "hash", "bitmap", "sorted", "auto" };
+#define SNAPSHOT_TEST_NUM_BACKENDS 5
+
+
+//
+// Checks one snapshot against the previous one seen by the same reader, whose members are flagged in
+// inPrevious[]; flags the snapshot's members in inCurrent[]. When growing, every previous member must
+// still be present, and when not, every current member must have been. Returns the number of errors.
+//
+int checkSnapshot( const SetVersion *version, int havePrevious, int previousSize, const char *inPrevious,
+                   char *inCurrent, int growing )
+{
+    int i, errors = 0, common = 0;
+
+    memset( inCurrent, 0, SNAPSHOT_TEST_SIZE*sizeof(char) );
+
+    if( version->size<0 || version->size>SNAPSHOT_TEST_SIZE ) return 1;
+
+    for( i=0; i<version->size; i++ )
+    {
+        int value = snapshotValue( version, i );
+
+        if( value<0 || value>=SNAPSHOT_TEST_SIZE || inCurrent[value] )
+        {
+            errors++;
+            continue;
+        }
+
+        inCurrent[value] = 1;
+        common += inPrevious[value];
+    }
+
+    if( havePrevious && common!=( growing ? previousSize : version->size ) ) errors++;
+
+    return errors;
+}
+
+//
+// Runs one phase: the writers add (or the first writer removes) values while the readers check snapshots,
+// until the writers are done. Returns the number of errors, and sets *reads to the snapshots checked.
+//
+int runSnapshotPhase( int growing, long *reads )
+{
+    int next = 0, writersLeft = SNAPSHOT_TEST_WRITERS, errors = 0;
+
+    *reads = 0;
+
+    #pragma omp parallel num_threads(SNAPSHOT_TEST_WRITERS+SNAPSHOT_TEST_READERS) reduction(+:errors)
+    {
+        int thread = omp_get_thread_num();
+
+        if( thread>=SNAPSHOT_TEST_READERS )
+        {
+            // Writers take the next value from a shared counter. Only one thread may call removeFromSet().
+            int i;
+
+            if( growing )
+                while( ( i=__atomic_fetch_add( &next, 1, __ATOMIC_RELAXED ) )<SNAPSHOT_TEST_ADDS )
+                    addToSet( (int) ( randomAt( SNAPSHOT_TEST_SEED, i ) % SNAPSHOT_TEST_SIZE ) );
+            else if( thread==SNAPSHOT_TEST_READERS )
+                for( i=0; i<SNAPSHOT_TEST_REMOVES; i++ )
+                    removeFromSet( (int) ( randomAt( SNAPSHOT_TEST_SEED+1, i ) % SNAPSHOT_TEST_SIZE ) );
+
+            __atomic_fetch_sub( &writersLeft, 1, __ATOMIC_RELEASE );
+        }
+        else
+        {
+            char *inPrevious = (char*) calloc( SNAPSHOT_TEST_SIZE, sizeof(char) );
+            char *inCurrent  = (char*) calloc( SNAPSHOT_TEST_SIZE, sizeof(char) );
+            int havePrevious = 0, previousSize = 0, last = 0;
+            long count = 0;
+
+            if( inPrevious==0 || inCurrent==0 )
+            {
+                printf( "WARNING: Failed to allocate memory for a snapshot reader.\n" );
+                errors++;
+                last = 1;
+            }
+
+            // One more read after the writers finish, so the final version is always checked.
+            while( !last )
+            {
+                last = ( __atomic_load_n( &writersLeft, __ATOMIC_ACQUIRE )==0 );
+
+                const SetVersion *version = acquireSnapshot( thread );
+                errors += checkSnapshot( version, havePrevious, previousSize, inPrevious, inCurrent, growing );
+                previousSize = version->size;
+                releaseSnapshot( thread );
+
+                char *swap = inPrevious;
+                inPrevious = inCurrent;
+                inCurrent  = swap;
+                havePrevious = 1;
+                count++;
+            }
+
+            __atomic_fetch_add( reads, count, __ATOMIC_RELAXED );
+            free( inPrevious );
+            free( inCurrent );
+        }
+    }
+
+    // With the writers done, the latest version is the set.
+    const SetVersion *version = acquireSnapshot( 0 );
+    int i;
+
+    syncSet();
+    if( version->size!=setSize ) errors++;
+    for( i=0; i<version->size && i<setSize; i++ )
+        if( snapshotValue( version, i )!=set[i] ) errors++;
+
+    releaseSnapshot( 0 );
+
+    return errors;
+}
+
+
+//
+// Main for the snapshot test.
+//
+int main()
+{
+    int backend, phase, failed = 0;
+
+    for( backend=0; backend<SNAPSHOT_TEST_NUM_BACKENDS; backend++ )
+    {
+        if( initSet(SNAPSHOT_TEST_SIZE)==-1 || initSetBackend(backend)==-1 || enableSetSnapshots()==-1 )
+            return EXIT_FAILURE;
+
+        for( phase=0; phase<2; phase++ )
+        {
+            long reads;
+            double start = omp_get_wtime();
+            int errors = runSnapshotPhase( phase==0, &reads );
+
+            printf( "%-6s: %d writer(s) %s while %d reader(s) checked %ld snapshots in %.3fs; %d errors.\n",
+                    snapshotTestBackends[backend], ( phase==0 ? SNAPSHOT_TEST_WRITERS : 1 ),
+                    ( phase==0 ? "added values" : "removed values" ), SNAPSHOT_TEST_READERS, reads,
+                    omp_get_wtime()-start, errors );
+
+            if( errors ) failed = 1;
+        }
+
+        destroySetBackend();
+        destroySet();
+    }
+
+    printf( failed ? "FAILED: A reader saw an inconsistent snapshot of the set.\n" : "All snapshots were consistent.\n" );
+
+    return ( failed ? EXIT_FAILURE : EXIT_SUCCESS );
+}
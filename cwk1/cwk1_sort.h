@@ -0,0 +1,140 @@
+//
+// Parallel merge sort for int arrays, using OpenMP tasks.
+//
+// Both halves are sorted as concurrent tasks, and the two sorted halves are merged by splitting at the
+// median of the longer run, so the final merges are parallel too. Short ranges drop to a serial merge
+// sort, and very short ones to insertion sort, to keep the task overhead down.
+//
+
+
+//
+// Parameters.
+//
+
+// Ranges of up to this length are sorted by insertion sort.
+#define SORT_INSERTION_CUTOFF 32
+
+// Ranges of up to this length are sorted or merged serially rather than spawning further tasks.
+#define SORT_TASK_CUTOFF 8192
+
+
+// Sorts the short range a[0..n-1] into out[0..n-1], which may be the same array as a or not overlap it.
+void insertionSortInto( const int *a, int n, int *out )
+{
+    int i, j;
+
+    for( i=0; i<n; i++ )
+    {
+        int value = a[i];
+        for( j=i; j>0 && out[j-1]>value; j-- ) out[j] = out[j-1];
+        out[j] = value;
+    }
+}
+
+// Sorts a short range in place.
+void insertionSort( int *a, int n )
+{
+    insertionSortInto( a, n, a );
+}
+
+// Returns the number of values in the sorted range a[0..n-1] that are less than value.
+int lowerBound( const int *a, int n, int value )
+{
+    int low = 0, high = n;
+
+    while( low<high )
+    {
+        int mid = low + (high-low)/2;
+        if( a[mid]<value ) low = mid+1; else high = mid;
+    }
+
+    return low;
+}
+
+// Merges the sorted ranges a and b into out, which must not overlap either.
+void mergeRuns( const int *a, int na, const int *b, int nb, int *out )
+{
+    // Keep a as the longer run, so halving it always makes progress.
+    if( na<nb )
+    {
+        const int *swap = a; a = b; b = swap;
+        int swapN = na; na = nb; nb = swapN;
+    }
+
+    if( na+nb<=SORT_TASK_CUTOFF )
+    {
+        int i = 0, j = 0, k = 0;
+        while( i<na && j<nb ) out[k++] = ( b[j]<a[i] ? b[j++] : a[i++] );
+        while( i<na ) out[k++] = a[i++];
+        while( j<nb ) out[k++] = b[j++];
+        return;
+    }
+
+    // The median of a splits b into a lower and upper part; each pair is then merged independently.
+    int ma = na/2, mb = lowerBound( b, nb, a[ma] );
+    out[ma+mb] = a[ma];
+
+    #pragma omp task
+    mergeRuns( a, ma, b, mb, out );
+
+    mergeRuns( a+ma+1, na-ma-1, b+mb, nb-mb, out+ma+mb+1 );
+
+    #pragma omp taskwait
+}
+
+// Sorts a[0..n-1], leaving the result in a if toTmp is 0 or in tmp[0..n-1] if not, with the other array as
+// scratch space. The halves are sorted into whichever array this level is not writing to and merged from
+// there, so the two arrays swap roles at each level and nothing is copied back.
+void mergeSortTasks( int *a, int *tmp, int n, int toTmp )
+{
+    int *out = ( toTmp ? tmp : a );
+
+    if( n<=SORT_INSERTION_CUTOFF )
+    {
+        insertionSortInto( a, n, out );
+        return;
+    }
+
+    int mid = n/2;
+
+    #pragma omp task if( n>SORT_TASK_CUTOFF )
+    mergeSortTasks( a, tmp, mid, !toTmp );
+
+    mergeSortTasks( a+mid, tmp+mid, n-mid, !toTmp );
+
+    #pragma omp taskwait
+
+    const int *in = ( toTmp ? a : tmp );
+    mergeRuns( in, mid, in+mid, n-mid, out );
+}
+
+// Compares two ints for qsort().
+int compareInts( const void *a, const void *b )
+{
+    int x = *(const int*) a, y = *(const int*) b;
+    return ( x>y ) - ( x<y );
+}
+
+// Sorts a[0..n-1] in increasing order using all available threads. Call from outside any parallel region.
+void parallelSort( int *a, int n )
+{
+    if( n<=SORT_INSERTION_CUTOFF )
+    {
+        insertionSort( a, n );
+        return;
+    }
+
+    int *tmp = (int*) malloc( n*sizeof(int) );
+    if( tmp==0 )
+    {
+        // No room for the scratch array, so fall back to an in-place serial sort.
+        qsort( a, n, sizeof(int), compareInts );
+        return;
+    }
+
+    #pragma omp parallel
+    #pragma omp single
+    mergeSortTasks( a, tmp, n, 0 );
+
+    free( tmp );
+}
@@ -10,10 +10,12 @@
 
 
 //
-// Includes
+// Includes. -std=c99 hides mmap() and friends unless asked for.
 //
+#define _DEFAULT_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <mpi.h>
 
 
@@ -21,6 +23,9 @@
 // as this file will be replaced with a different version for assessment.
 #include "cwk2_extra.h"
 
+// Memory-mapped and MPI-IO input with 64-bit sizes.
+#include "cwk2_io.h"
+
 
 //
 // Case is not considered (i.e. 'a' is the same as 'A'), and any non-alphabetic characters
@@ -29,32 +34,643 @@
 #define MAX_LETTERS 26
 
 
+// Table-driven and AVX2 letter counting kernels, and OpenMP-parallel counting within a rank.
+#include "cwk2_count.h"
+
+// Binomial, pipelined chain and two-level collectives, chosen by a model of the measured network.
+#include "cwk2_coll.h"
+
+// Byte, UTF-8 and k-gram histograms, written to their own file.
+#include "cwk2_buckets.h"
+#define BUCKETS_FILE "buckets.out"
+
+// Per-rank timers for each phase, combined over the ranks at the end.
+#include "cwk2_timers.h"
+
+// Many files counted together, handed out to ranks from a work pool on rank 0.
+#include "cwk2_corpus.h"
+
+// The histogram with how much of the file it covers, so a rerun only counts what has been appended.
+#include "cwk2_checkpoint.h"
+
+// Binary histograms written by every rank, which cwk2_merge sums.
+#include "cwk2_shard.h"
+
+
+//
+// Ways of reading the input file on rank 0:
+// READ_TEXT - readText() from cwk2_extra.h, which copies the file one character at a time into a padded
+//             buffer and is limited to 2GB.
+// READ_MMAP - mapText() from cwk2_io.h; no copy, 64-bit sizes, and each rank's block starts on a page.
+// READ_MPIIO - readTextMPIIO() from cwk2_io.h; every rank reads its own block, so there is no scatter and
+//              the input is not limited by rank 0's memory.
+// READ_SHARED - mapText() as READ_MMAP, then one copy per node into a shared-memory window, which the
+//               node's ranks count from directly.
+//
+#define READ_TEXT   0
+#define READ_MMAP   1
+#define READ_MPIIO  2
+#define READ_SHARED 3
+
+const char *readNames[] = {"text", "mmap", "mpiio", "shared"};
+
+// The largest number of bytes sent to each rank by one MPI_Scatter(), so int counts cannot overflow.
+#define SCATTER_ROUND (1L << 30)
+
+//
+// Ways of splitting the text between ranks:
+// SPLIT_PADDED   - equal blocks, after padding the text to a multiple of the number of ranks.
+// SPLIT_BALANCED - no padding, with block sizes differing by at most one character.
+// SPLIT_WEIGHTED - no padding, with block sizes in proportion to a weight per rank.
+//
+#define SPLIT_PADDED   0
+#define SPLIT_BALANCED 1
+#define SPLIT_WEIGHTED 2
+
+const char *splitNames[] = {"padded", "balanced", "weighted"};
+
+// When pipelined, bytes counted between checks on the chunk in flight, so MPI can progress it meanwhile.
+#define PIPELINE_TEST_INTERVAL (1L << 20)
+
+
+//
+// Command line options. All are optional; with none, behaves as the original coursework.
+//
+typedef struct {
+    char *fname;            // The input file.
+    int readMode;           // One of the READ_... codes.
+    int numThreads;         // OpenMP threads per rank for counting; 0 means one per available core.
+    long chunkSize;         // Bytes per rank per chunk when scatter and count are pipelined; 0 if not.
+    BucketSpec buckets;     // Histogram counted as well as the letters; kind BUCKET_NONE if none.
+    int split;              // One of the SPLIT_... codes.
+    double *weights;        // One per rank for SPLIT_WEIGHTED, else NULL; to be free()'d.
+    int collective;         // One of the COLL_... algorithms for the broadcast, scatter and reduction.
+    char *timingFile;       // CSV file the phase timings are appended to; NULL if none.
+    char *corpus;           // Directory or file list counted instead of fname; NULL if none.
+    long pieceSize;         // Largest piece of a file the work pool hands out at once.
+    char *checkpoint;       // Checkpoint file resumed from and saved to; NULL if none.
+    char *shardPrefix;      // Start of the names of each rank's binary shards; NULL if none are written.
+    char *progress;         // File recording each finished piece of the work pool; NULL if none.
+    int resume;             // Whether to resume from the pieces already in the progress file.
+} Options;
+
+// Parses the weights for "-split w0,w1,...", which must be positive with one per rank. Returns a newly
+// allocated array, or NULL if they are not valid.
+double *parseWeights(const char *list, int numProcs) {
+    double *weights = (double *) malloc(numProcs * sizeof(double));
+    const char *p = list;
+    int r;
+
+    for (r = 0; weights != NULL && r < numProcs; r++) {
+        char *end;
+        weights[r] = strtod(p, &end);
+        if (end == p || weights[r] <= 0.0 || *end != (r == numProcs - 1 ? '\0' : ',')) {
+            free(weights);
+            return NULL;
+        }
+        p = end + 1;
+    }
+
+    return weights;
+}
+
+// Parses "./cwk2 [-read text|mmap|mpiio|shared] [-threads N] [-chunk BYTES] [-buckets SPEC] [-split padded|balanced|
+// w0,w1,...] [-coll auto|native|binomial|chain|twolevel] [-timing CSV] [-corpus DIR|LIST] [-checkpoint
+// FILE] [-shard PREFIX] [-progress FILE [-resume]] [-piece BYTES] [file]". Returns 0 if okay, -1 if not, printing
+// usage on rank 0.
+int parseOptions(int argc, char **argv, int rank, int numProcs, Options *opts) {
+    int i, c;
+
+    opts->fname = "input.txt";
+    opts->readMode = READ_TEXT;
+    opts->numThreads = 1;
+    opts->chunkSize = 0;
+    opts->buckets.kind = BUCKET_NONE;
+    opts->split = SPLIT_PADDED;
+    opts->weights = NULL;
+    opts->collective = COLL_AUTO;
+    opts->timingFile = NULL;
+    opts->corpus = NULL;
+    opts->pieceSize = CORPUS_PIECE;
+    opts->checkpoint = NULL;
+    opts->shardPrefix = NULL;
+    opts->progress = NULL;
+    opts->resume = 0;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-read") && i + 1 < argc) {
+            i++;
+            if (!strcmp(argv[i], "text")) opts->readMode = READ_TEXT;
+            else if (!strcmp(argv[i], "mmap")) opts->readMode = READ_MMAP;
+            else if (!strcmp(argv[i], "mpiio")) opts->readMode = READ_MPIIO;
+            else if (!strcmp(argv[i], "shared")) opts->readMode = READ_SHARED;
+            else break;
+        } else if (!strcmp(argv[i], "-threads") && i + 1 < argc) {
+            opts->numThreads = atoi(argv[++i]);
+            if (opts->numThreads < 0) break;
+        } else if (!strcmp(argv[i], "-chunk") && i + 1 < argc) {
+            opts->chunkSize = atol(argv[++i]);
+            if (opts->chunkSize < 0) break;
+        } else if (!strcmp(argv[i], "-buckets") && i + 1 < argc) {
+            if (parseBucketSpec(argv[++i], &opts->buckets) == -1) break;
+        } else if (!strcmp(argv[i], "-split") && i + 1 < argc) {
+            i++;
+            if (!strcmp(argv[i], "padded")) opts->split = SPLIT_PADDED;
+            else if (!strcmp(argv[i], "balanced")) opts->split = SPLIT_BALANCED;
+            else if ((opts->weights = parseWeights(argv[i], numProcs)) != NULL) opts->split = SPLIT_WEIGHTED;
+            else break;
+        } else if (!strcmp(argv[i], "-coll") && i + 1 < argc) {
+            i++;
+            for (c = 0; c < COLL_NUM_ALGORITHMS && strcmp(argv[i], collNames[c]); c++);
+            if (c == COLL_NUM_ALGORITHMS) break;
+            opts->collective = c;
+        } else if (!strcmp(argv[i], "-timing") && i + 1 < argc) {
+            opts->timingFile = argv[++i];
+        } else if (!strcmp(argv[i], "-corpus") && i + 1 < argc) {
+            opts->corpus = argv[++i];
+        } else if (!strcmp(argv[i], "-piece") && i + 1 < argc) {
+            opts->pieceSize = atol(argv[++i]);
+            if (opts->pieceSize <= 0) break;
+        } else if (!strcmp(argv[i], "-checkpoint") && i + 1 < argc) {
+            opts->checkpoint = argv[++i];
+        } else if (!strcmp(argv[i], "-shard") && i + 1 < argc) {
+            opts->shardPrefix = argv[++i];
+        } else if (!strcmp(argv[i], "-progress") && i + 1 < argc) {
+            opts->progress = argv[++i];
+        } else if (!strcmp(argv[i], "-resume")) {
+            opts->resume = 1;
+        } else if (argv[i][0] != '-' && i == argc - 1) {
+            opts->fname = argv[i];
+        } else {
+            break;
+        }
+    }
+
+    // The buckets are counted from each rank's whole block, which pipelining never holds.
+    if (i == argc && opts->buckets.kind != BUCKET_NONE && opts->chunkSize > 0) {
+        if (rank == 0) printf("-buckets cannot be combined with -chunk.\n");
+        return -1;
+    }
+
+    // MPI-IO, shared windows and pipelining all rely on every rank having the same block size.
+    int sameBlocks = (opts->readMode == READ_MPIIO || opts->readMode == READ_SHARED || opts->chunkSize > 0);
+    if (i == argc && opts->split != SPLIT_PADDED && sameBlocks) {
+        if (rank == 0) printf("-split balanced or weighted cannot be combined with -read mpiio or shared, or -chunk.\n");
+        return -1;
+    }
+
+    // Pipelining replaces the scatter, which MPI-IO and shared windows do not use.
+    if (i == argc && opts->chunkSize > 0 && (opts->readMode == READ_MPIIO || opts->readMode == READ_SHARED)) {
+        if (rank == 0) printf("-chunk cannot be combined with -read mpiio or shared.\n");
+        return -1;
+    }
+
+    // A corpus is read a piece at a time by the ranks that count it, so it has no single text to distribute.
+    // Recording progress uses the same work pool, with the file as a corpus of one.
+    int singleText = (opts->readMode != READ_TEXT || opts->chunkSize > 0 || opts->split != SPLIT_PADDED ||
+                      opts->buckets.kind != BUCKET_NONE);
+    if (i == argc && (opts->corpus != NULL || opts->progress != NULL) && singleText) {
+        if (rank == 0) printf("-corpus and -progress cannot be combined with -read, -chunk, -split or -buckets.\n");
+        return -1;
+    }
+    if (i == argc && opts->resume && opts->progress == NULL) {
+        if (rank == 0) printf("-resume needs -progress.\n");
+        return -1;
+    }
+    if (i == argc && opts->pieceSize != CORPUS_PIECE && opts->corpus == NULL && opts->progress == NULL) {
+        if (rank == 0) printf("-piece needs -corpus or -progress.\n");
+        return -1;
+    }
+
+    // Only the appended part is counted, from the mapped file and split without padding, as its length is
+    // arbitrary. The buckets are not saved in the checkpoint.
+    int wholeFile = (opts->readMode == READ_MPIIO || opts->readMode == READ_SHARED || opts->chunkSize > 0 ||
+                     opts->buckets.kind != BUCKET_NONE || opts->corpus != NULL || opts->progress != NULL);
+    if (i == argc && opts->checkpoint != NULL && wholeFile) {
+        if (rank == 0)
+            printf("-checkpoint cannot be combined with -read mpiio or shared, -chunk, -buckets, -corpus or -progress.\n");
+        return -1;
+    }
+    if (opts->checkpoint != NULL) {
+        opts->readMode = READ_MMAP;
+        if (opts->split == SPLIT_PADDED) opts->split = SPLIT_BALANCED;
+    }
+
+    if (i == argc) {
+#ifdef _OPENMP
+        if (opts->numThreads == 0) opts->numThreads = omp_get_max_threads();
+#endif
+        return 0;
+    }
+
+    if (rank == 0)
+        printf("Usage: %s [-read text|mmap|mpiio|shared] [-threads N] [-chunk BYTES] [-buckets SPEC] [-split padded|balanced|"
+               "w0,w1,...] [-coll auto|native|binomial|chain|twolevel] [-timing CSV] [-corpus DIR|LIST] [-checkpoint FILE]"
+               " [-shard PREFIX] [-progress FILE [-resume]] [-piece BYTES] [file]; the file defaults to input.txt, and N to"
+               " 1 (0 for one thread per core). With -chunk, scattering and counting are pipelined. SPEC is bytes, utf8,"
+               " letters or kgram:K (K up to %d), saved to " BUCKETS_FILE ". -split balanced or with %d positive weights"
+               " divides the text without padding. -coll chooses the collective algorithms. -timing appends the phase"
+               " timings to CSV. -corpus counts every file in DIR, or listed one per line in LIST, instead of the file."
+               " -checkpoint only counts what has been appended to the file since FILE was saved, then saves it again."
+               " -shard writes each rank's own counts to PREFIX.RANK.shard (and PREFIX.RANK.buckets.shard)."
+               " -progress records each finished piece of the work so a failed run can be continued with -resume."
+               " -piece sets the largest piece of a file handed out at once (default %ld).\n",
+               argv[0], MAX_KGRAM, numProcs, CORPUS_PIECE);
+    return -1;
+}
+
+
+//
+// Sends the number of characters per process from rank 0 (the only rank that knows totalChars) to all
+// ranks, returning it. Works for any number of processes; with COLL_AUTO a message this small goes down a
+// binomial tree, or between node leaders first if that is predicted to be faster.
+//
+long broadcastCharsPerProc(long totalChars, int rank, int numProcs, const Collectives *coll, int algorithm) {
+    // Calculate the number of characters per process. Note that only rank 0 has the correct value of totalChars
+    // (and hence charsPerproc) at this point. Also, we know by this point that totalChars is a multiple of numProcs.
+    long charsPerProc = (rank == 0 ? totalChars / numProcs : 0);
+
+    collBcast(&charsPerProc, 1, MPI_LONG, coll, algorithm);
+
+    return charsPerProc;
+}
+
+//
+// Returns a committed datatype of len characters whose extent is the whole block of charsPerProc, so that
+// one of them per rank picks the same part of every rank's block. The offsets MPI computes from it are
+// 64-bit and only the count is an int.
+//
+MPI_Datatype stridedBlockType(int len, long charsPerProc) {
+    MPI_Datatype block, blockAtStride;
+
+    MPI_Type_contiguous(len, MPI_CHAR, &block);
+    MPI_Type_create_resized(block, 0, (MPI_Aint) charsPerProc, &blockAtStride);
+    MPI_Type_commit(&blockAtStride);
+    MPI_Type_free(&block);
+
+    return blockAtStride;
+}
+
+//
+// Sends consecutive blocks of charsPerProc characters from rank 0's fullText to localText on every rank,
+// in rounds of at most SCATTER_ROUND, with the given collective algorithm. If rank 0's localText already
+// points at its own block of fullText, that block is left in place rather than copied.
+//
+void scatterText(char *fullText, char *localText, long charsPerProc, int rank, const Collectives *coll,
+                 int algorithm) {
+    long offset;
+
+    for (offset = 0; offset < charsPerProc; offset += SCATTER_ROUND) {
+        int len = (int) (charsPerProc - offset < SCATTER_ROUND ? charsPerProc - offset : SCATTER_ROUND);
+
+        MPI_Datatype blockAtStride = stridedBlockType(len, charsPerProc);
+
+        int inPlace = (rank == 0 && localText == fullText);
+        collScatter(
+                rank == 0 ? fullText + offset : NULL, 1, blockAtStride,
+                inPlace ? MPI_IN_PLACE : localText + offset, len, MPI_CHAR,
+                coll, algorithm
+        );
+
+        MPI_Type_free(&blockAtStride);
+    }
+}
+
+//
+// Sends or receives one block of charsPerProc characters in rounds of at most SCATTER_ROUND.
+//
+void sendBlock(const char *block, long charsPerProc, int dest) {
+    long offset;
+
+    for (offset = 0; offset < charsPerProc; offset += SCATTER_ROUND) {
+        int len = (int) (charsPerProc - offset < SCATTER_ROUND ? charsPerProc - offset : SCATTER_ROUND);
+        MPI_Send(block + offset, len, MPI_CHAR, dest, 0, MPI_COMM_WORLD);
+    }
+}
+
+void recvBlock(char *block, long charsPerProc, int source) {
+    long offset;
+
+    for (offset = 0; offset < charsPerProc; offset += SCATTER_ROUND) {
+        int len = (int) (charsPerProc - offset < SCATTER_ROUND ? charsPerProc - offset : SCATTER_ROUND);
+        MPI_Recv(block + offset, len, MPI_CHAR, source, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    }
+}
+
+//
+// Distributes rank 0's fullText through one shared-memory window per node, returning this rank's block of
+// charsPerProc characters within it. Node 0's blocks are copied into its window from rank 0's mapping, and
+// every other node's blocks are sent once to its leader's window; no rank then copies its own block. The
+// window stays in a passive target epoch until it is freed with MPI_Win_unlock_all() and MPI_Win_free().
+//
+char *distributeShared(const char *fullText, long charsPerProc, const Collectives *coll, MPI_Win *win) {
+    long nodeChars = (coll->nodeRank == 0 ? coll->nodeSize * charsPerProc : 0), slot;
+    char *base;
+    int r;
+
+    MPI_Win_allocate_shared((MPI_Aint) nodeChars, 1, MPI_INFO_NULL, coll->node, &base, win);
+
+    MPI_Aint windowSize;
+    int dispUnit;
+    MPI_Win_shared_query(*win, 0, &windowSize, &dispUnit, &base);
+
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, *win);
+
+    // The node's ranks are in world order, so its leader fills the window in that order too. Messages from
+    // rank 0 to each leader arrive in the order they were sent.
+    if (coll->nodeRank == 0) {
+        for (slot = 0, r = 0; r < coll->numProcs; r++) {
+            if (coll->nodeOf[r] != coll->nodeOf[coll->rank]) continue;
+
+            if (coll->rank == 0)
+                memcpy(base + slot * charsPerProc, fullText + r * charsPerProc, charsPerProc);
+            else
+                recvBlock(base + slot * charsPerProc, charsPerProc, 0);
+            slot++;
+        }
+    }
+    if (coll->rank == 0)
+        for (r = 0; r < coll->numProcs; r++)
+            if (coll->nodeOf[r] != 0) sendBlock(fullText + r * charsPerProc, charsPerProc, coll->nodeFirst[coll->nodeOf[r]]);
+
+    // Make the leader's stores visible to the rest of the node before anyone reads.
+    MPI_Win_sync(*win);
+    MPI_Barrier(coll->node);
+    MPI_Win_sync(*win);
+
+    return base + coll->nodeRank * charsPerProc;
+}
+
+//
+// Sets counts[] and displs[] so consecutive blocks cover totalChars characters with sizes in proportion to
+// the weights, or equal if weights is NULL. Every boundary is the exact one rounded down, so each block is
+// within one character of its exact share. All ranks compute the same split.
+//
+void splitText(long totalChars, int numProcs, const double *weights, long *counts, long *displs) {
+    double totalWeight = 0.0, cumulative = 0.0;
+    int r;
+
+    for (r = 0; r < numProcs; r++) totalWeight += (weights != NULL ? weights[r] : 1.0);
+
+    for (r = 0; r < numProcs; r++) {
+        if (weights == NULL)
+            displs[r] = (totalChars / numProcs) * r + (r < totalChars % numProcs ? r : totalChars % numProcs);
+        else
+            displs[r] = (long) ((long double) totalChars * cumulative / totalWeight);
+        cumulative += (weights != NULL ? weights[r] : 1.0);
+    }
+
+    for (r = 0; r < numProcs; r++) counts[r] = (r < numProcs - 1 ? displs[r + 1] : totalChars) - displs[r];
+}
+
+//
+// Sends block r of rank 0's fullText, of counts[r] characters starting at displs[r], to localText on every
+// rank r with MPI_Scatterv(). The text is sent in windows of SCATTER_ROUND characters, each rank receiving
+// the part of its block in the window, so the int counts and displacements cannot overflow. If rank 0's
+// localText already points at its own block of fullText, that block is left in place.
+//
+void scatterTextV(char *fullText, char *localText, const long *counts, const long *displs, long totalChars,
+                  int rank, int numProcs) {
+    int *roundCounts = (int *) malloc(numProcs * sizeof(int));
+    int *roundDispls = (int *) malloc(numProcs * sizeof(int));
+    long base;
+    int r;
+
+    if (roundCounts == NULL || roundDispls == NULL) {
+        printf("Rank %d: Could not allocate memory for the scatter counts.\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+
+    for (base = 0; base < totalChars; base += SCATTER_ROUND) {
+        long end = (base + SCATTER_ROUND < totalChars ? base + SCATTER_ROUND : totalChars);
+
+        for (r = 0; r < numProcs; r++) {
+            long from = (displs[r] > base ? displs[r] : base);
+            long to = (displs[r] + counts[r] < end ? displs[r] + counts[r] : end);
+
+            roundCounts[r] = (int) (to > from ? to - from : 0);
+            roundDispls[r] = (int) (to > from ? from - base : 0);
+        }
+
+        long received = (displs[rank] > base ? 0 : base - displs[rank]);
+        int inPlace = (rank == 0 && localText == fullText);
+        MPI_Scatterv(
+                rank == 0 ? fullText + base : NULL, roundCounts, roundDispls, MPI_CHAR,
+                inPlace ? MPI_IN_PLACE : localText + received, roundCounts[rank], MPI_CHAR,
+                0, MPI_COMM_WORLD
+        );
+    }
+
+    free(roundCounts);
+    free(roundDispls);
+}
+
+//
+// Scatters and counts in chunks of chunkSize characters from every rank's block, adding the counts to
+// hist[]. Chunks are received into two buffers in turn with MPI_Iscatter(), so chunk k+1 is in flight
+// while chunk k is counted, and ranks other than 0 never hold more than two chunks. Rank 0 counts its own
+// block in place in fullText. Time spent waiting for chunks is added to the scatter phase of timers, and
+// time spent counting them to the count phase.
+//
+void scatterAndCountPipelined(char *fullText, long charsPerProc, long chunkSize, int rank, int numThreads,
+                              int *hist, PhaseTimers *timers) {
+    if (chunkSize > SCATTER_ROUND) chunkSize = SCATTER_ROUND;
+    if (chunkSize > charsPerProc) chunkSize = charsPerProc;
+
+    char *buffers[2] = {NULL, NULL};
+    if (rank != 0) {
+        buffers[0] = (char *) malloc(chunkSize * sizeof(char));
+        buffers[1] = (char *) malloc(chunkSize * sizeof(char));
+        if (buffers[0] == NULL || buffers[1] == NULL) {
+            printf("Rank %d: Could not allocate memory for the chunk buffers.\n", rank);
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+    }
+
+    long numChunks = (charsPerProc + chunkSize - 1) / chunkSize, k;
+    MPI_Request requests[2];
+
+    for (k = 0; k <= numChunks; k++) {
+        // Start sending the next chunk before counting this one. The datatype can be freed straight away, as
+        // MPI keeps it until the scatter completes.
+        if (k < numChunks) {
+            long offset = k * chunkSize;
+            int len = (int) (charsPerProc - offset < chunkSize ? charsPerProc - offset : chunkSize);
+
+            MPI_Datatype blockAtStride = stridedBlockType(len, charsPerProc);
+            MPI_Iscatter(
+                    rank == 0 ? fullText + offset : NULL, 1, blockAtStride,
+                    rank == 0 ? MPI_IN_PLACE : buffers[k % 2], len, MPI_CHAR,
+                    0, MPI_COMM_WORLD, &requests[k % 2]
+            );
+            MPI_Type_free(&blockAtStride);
+        }
+        if (k == 0) continue;
+
+        // Count the previous chunk, checking the next one between pieces so MPI can progress it.
+        long offset = (k - 1) * chunkSize, done;
+        long len = (charsPerProc - offset < chunkSize ? charsPerProc - offset : chunkSize);
+        const char *chunk = (rank == 0 ? fullText + offset : buffers[(k - 1) % 2]);
+
+        double lapStart = MPI_Wtime();
+        MPI_Wait(&requests[(k - 1) % 2], MPI_STATUS_IGNORE);
+        lapStart = lapPhase(timers, PHASE_SCATTER, len, lapStart);
+        for (done = 0; done < len; done += PIPELINE_TEST_INTERVAL) {
+            int flag;
+            countLettersParallel(chunk + done, (len - done < PIPELINE_TEST_INTERVAL ? len - done : PIPELINE_TEST_INTERVAL),
+                                 numThreads, hist);
+            if (k < numChunks) MPI_Test(&requests[k % 2], &flag, MPI_STATUS_IGNORE);
+        }
+        lapPhase(timers, PHASE_COUNT, len, lapStart);
+    }
+
+    free(buffers[0]);
+    free(buffers[1]);
+}
+
+
+//
+// Writes this rank's letter or bucket histogram, before any reduction, as a binary shard for cwk2_merge. For the
+// letters, the counts from before a checkpoint can be added in (otherwise NULL), so that the shards still sum to
+// the whole file. Returns 0 if okay, -1 after printing an error message if not.
+//
+int saveLetterShard(const char *prefix, int rank, const int *hist, const int *before) {
+    char fname[4096];
+    uint64_t counts[MAX_LETTERS];
+    ShardHeader header;
+    int i;
+
+    for (i = 0; i < MAX_LETTERS; i++) counts[i] = (uint64_t) hist[i] + (before != NULL ? (uint64_t) before[i] : 0);
+    initShardHeader(&header, BUCKET_KGRAM, 1, MAX_LETTERS, SHARD_DENSE, MAX_LETTERS);
+
+    snprintf(fname, sizeof(fname), "%s.%d.shard", prefix, rank);
+    return writeShard(fname, &header, counts);
+}
+
+int saveBucketShard(const char *prefix, int rank, const BucketSpec *spec, const BucketHist *h) {
+    char fname[4096];
+    ShardHeader header;
+    void *data;
+    long i, n;
+
+    // Dense histograms are written whole, and sparse ones as their non-empty buckets in order of key.
+    if (h->dense != NULL) {
+        uint64_t *counts = (uint64_t *) malloc(spec->numBuckets * sizeof(uint64_t));
+        for (i = 0; counts != NULL && i < (long) spec->numBuckets; i++) counts[i] = (uint64_t) h->dense[i];
+        initShardHeader(&header, spec->kind, spec->k, spec->numBuckets, SHARD_DENSE, spec->numBuckets);
+        data = counts;
+    } else {
+        HistEntry *entries = collectBuckets(h, spec, &n);
+        ShardRecord *records = (ShardRecord *) malloc((n > 0 ? n : 1) * sizeof(ShardRecord));
+        for (i = 0; entries != NULL && records != NULL && i < n; i++) {
+            records[i].key = entries[i].key;
+            records[i].count = entries[i].count;
+        }
+        if (entries == NULL) {
+            free(records);
+            records = NULL;
+        }
+        free(entries);
+        initShardHeader(&header, spec->kind, spec->k, spec->numBuckets, SHARD_SPARSE, (uint64_t) n);
+        data = records;
+    }
+
+    if (data == NULL) {
+        printf("Rank %d: Could not allocate memory for the bucket shard.\n", rank);
+        return -1;
+    }
+
+    snprintf(fname, sizeof(fname), "%s.%d.buckets.shard", prefix, rank);
+    int status = writeShard(fname, &header, data);
+    free(data);
+    return status;
+}
+
+
 //
 // Main
 //
 int main(int argc, char **argv) {
-    int i, lc, charsPerProc;
+    int i, lc;
+    long j, charsPerProc, localChars, localOffset;
 
-    // Initialise MPI and get the rank and no. of processes.
-    int rank, numProcs;
-    MPI_Init(&argc, &argv);
+    // Initialise MPI and get the rank and no. of processes. Only the main thread of each rank makes MPI calls;
+    // OpenMP threads are only used for counting.
+    int rank, numProcs, threadSupport;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &threadSupport);
     MPI_Comm_size(MPI_COMM_WORLD, &numProcs);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
-    // Read in the text file to rank 0.
+    Options opts;
+    if (parseOptions(argc, argv, rank, numProcs, &opts) == -1) {
+        MPI_Finalize();
+        return EXIT_FAILURE;
+    }
+
+    // Find the nodes and measure the network, for choosing the collective algorithms.
+    Collectives coll;
+    collInit(&coll);
+    if (rank == 0)
+        printf("Rank 0: %d rank(s) on %d node(s); latency %.3g us within a node, %.3g us between; %s collectives.\n",
+               numProcs, coll.numNodes, 1e6 * coll.alphaIntra, 1e6 * coll.alphaInter, collNames[opts.collective]);
+
+    // Time each phase on every rank, starting with the read.
+    PhaseTimers timers;
+    initPhaseTimers(&timers);
+    double lapStart = MPI_Wtime();
+
+    // Read in the text file to rank 0, unless each rank will read its own block.
     char *fullText = NULL;
-    int totalChars = 0;
-    if (rank == 0) {
-        // Try to read in the file. The pointer 'text' must be free()'d before termination. Will add spaces to the
-        // end so that the total size of the text array is a multiple of numProcs. Will print an error message and
-        // return NULL if the operation could not be completed for any reason.
-        fullText = readText("input.txt", &totalChars, numProcs);
+    long totalChars = 0;
+    MappedText mapped;
+    Corpus corpus;
+    initCorpus(&corpus);
+    Checkpoint checkpoint;
+    Progress progress;
+    if (rank == 0 && (opts.corpus != NULL || opts.progress != NULL)) {
+        // Only list the files, or the one file; each piece is read by the rank it is handed to.
+        int listed = (opts.corpus != NULL ? listCorpus(opts.corpus, &corpus) : addCorpusPath(&corpus, opts.fname));
+        if (listed == -1) {
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+            return EXIT_FAILURE;
+        }
+        totalChars = corpus.totalSize;
+
+        printf("Rank 0: Listed %d files with %ld characters in the corpus.\n", corpus.numFiles, totalChars);
+        lapPhase(&timers, PHASE_READ, 0, lapStart);
+    } else if (rank == 0 && opts.readMode != READ_MPIIO) {
+        if (opts.readMode == READ_MMAP || opts.readMode == READ_SHARED) {
+            // Map the file, with virtual padding so every rank's block is a whole number of pages unless it is
+            // split without padding. Blocks copied into shared windows need no alignment.
+            long padding = (opts.split == SPLIT_PADDED ? numProcs * sysconf(_SC_PAGESIZE) : 1);
+            if (opts.readMode == READ_SHARED) padding = numProcs;
+            if (mapText(opts.fname, padding, &mapped) == 0) {
+                fullText = mapped.text;
+                totalChars = mapped.paddedSize;
+            }
+        } else {
+            // Try to read in the file. The pointer 'text' must be free()'d before termination. Will add spaces to the
+            // end so that the total size of the text array is a multiple of numProcs. Will print an error message and
+            // return NULL if the operation could not be completed for any reason.
+            int readChars = 0;
+            fullText = readText(opts.fname, &readChars, opts.split == SPLIT_PADDED ? numProcs : 1);
+            totalChars = readChars;
+        }
         if (fullText == NULL) {
-            MPI_Finalize();
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
             return EXIT_FAILURE;
         }
 
-        printf("Rank 0: Read in text file with %d characters (including padding).\n", totalChars);
+        printf("Rank 0: Read in text file with %ld characters (including padding).\n", totalChars);
+
+        // With a checkpoint, only distribute and count what has been appended since it was saved.
+        if (opts.checkpoint != NULL) {
+            long resumeAt = loadCheckpoint(opts.checkpoint, opts.fname, &mapped, &checkpoint);
+            fullText += resumeAt;
+            totalChars = mapped.size - resumeAt;
+            printf("Rank 0: Checkpoint covers %ld characters; counting the %ld after them.\n", resumeAt, totalChars);
+        }
+        lapPhase(&timers, PHASE_READ, totalChars, lapStart);
     }
 
     // The final global histogram - declared for all processes but the final answer will only be on rank 0.
@@ -67,73 +683,153 @@ int main(int argc, char **argv) {
     for (i = 0; i < MAX_LETTERS; i++) localHist[i] = 0;
 
     char *localText = NULL;
+    MPI_Win sharedWin = MPI_WIN_NULL;
 
     // Start the timing.
     double startTime = MPI_Wtime();
-
-    //
-    // Step 1. Dynamically allocate memory for each process
-    //
-
-
-    if ((numProcs && ((numProcs & (numProcs - 1)) == 0)) && numProcs != 1) {
-        int lev = 1;
-
-        while (1 << lev <= numProcs) {
-            for (int p = 0; p < 1 << (lev - 1); p++) {
-                int dest = p + (1<<(lev-1));
-
-                if (rank == p) {
-                    if(rank == 0) charsPerProc = totalChars / numProcs;
-
-                    MPI_Send(&charsPerProc, 1, MPI_INT, dest, 0, MPI_COMM_WORLD);
-                }
-
-                if (rank == dest)
-                {
-                    MPI_Recv(&charsPerProc, 1, MPI_INT, p, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                }
-            }
-
-            lev++;
+    lapStart = startTime;
+
+    if (opts.corpus != NULL || opts.progress != NULL) {
+        //
+        // Steps 1 to 3 from a work pool: rank 0 hands out pieces of the files to the other ranks, which read
+        // and count them.
+        //
+
+        corpus.pieceSize = opts.pieceSize;
+        broadcastCorpus(&corpus, rank, &coll, opts.collective);
+        lapStart = lapPhase(&timers, PHASE_BCAST, corpus.namesLength, lapStart);
+
+        // Rank 0 adds in the counts of pieces finished by an earlier run, which are not handed out again.
+        if (rank == 0 && opts.progress != NULL) {
+            if (openProgress(opts.progress, opts.resume, &corpus, &progress, localHist) == -1)
+                MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+            if (opts.resume)
+                printf("Rank 0: Resuming with %ld of %ld pieces already counted.\n", progress.numDone, progress.numPieces);
         }
 
-        localText = (char *) malloc(charsPerProc * sizeof(char));
-
+        long numPieces = countCorpus(&corpus, rank, numProcs, opts.numThreads, localHist,
+                                     (opts.progress != NULL ? &progress : NULL), &timers);
+        lapStart = MPI_Wtime();
+        if (rank == 0)
+            printf("Rank 0: Handed out %ld pieces of up to %ld characters to %d rank(s).\n", numPieces, corpus.pieceSize,
+                   (numProcs > 1 ? numProcs - 1 : 1));
+        localChars = 0;
+        localOffset = 0;
+    } else if (opts.readMode == READ_MPIIO) {
+        //
+        // Steps 1 and 2 in one for MPI-IO: each rank allocates and reads its own block, with no scatter.
+        //
+
+        localText = readTextMPIIO(opts.fname, rank, numProcs, &charsPerProc, &totalChars);
+        if (localText == NULL) {
+            MPI_Finalize();
+            return EXIT_FAILURE;
+        }
+        lapStart = lapPhase(&timers, PHASE_READ, charsPerProc, lapStart);
+        if (rank == 0)
+            printf("Each rank read %ld characters with MPI-IO (%ld including padding).\n", charsPerProc, totalChars);
+        localChars = charsPerProc;
+        localOffset = rank * charsPerProc;
+    } else if (opts.readMode == READ_SHARED) {
+        //
+        // Steps 1 and 2 through shared memory: one copy of the text per node, counted where it lands.
+        //
+
+        charsPerProc = broadcastCharsPerProc(totalChars, rank, numProcs, &coll, opts.collective);
+        lapStart = lapPhase(&timers, PHASE_BCAST, sizeof(long), lapStart);
+
+        localText = distributeShared(fullText, charsPerProc, &coll, &sharedWin);
+        lapStart = lapPhase(&timers, PHASE_SCATTER, charsPerProc, lapStart);
+        localChars = charsPerProc;
+        localOffset = rank * charsPerProc;
+    } else if (opts.chunkSize > 0) {
+        //
+        // Steps 1 to 3 pipelined: only the chunks in flight are allocated, and counted as they arrive.
+        //
+
+        charsPerProc = broadcastCharsPerProc(totalChars, rank, numProcs, &coll, opts.collective);
+        lapPhase(&timers, PHASE_BCAST, sizeof(long), lapStart);
+
+        scatterAndCountPipelined(fullText, charsPerProc, opts.chunkSize, rank, opts.numThreads, localHist, &timers);
+        lapStart = MPI_Wtime();
+        localChars = charsPerProc;
+        localOffset = rank * charsPerProc;
+    } else if (opts.split != SPLIT_PADDED) {
+        //
+        // Steps 1 and 2 for blocks of different sizes, with no padding.
+        //
+
+        MPI_Bcast(&totalChars, 1, MPI_LONG, 0, MPI_COMM_WORLD);
+        lapStart = lapPhase(&timers, PHASE_BCAST, sizeof(long), lapStart);
+
+        long *counts = (long *) malloc(numProcs * sizeof(long)), *displs = (long *) malloc(numProcs * sizeof(long));
+        if (counts == NULL || displs == NULL) {
+            printf("Rank %d: Could not allocate memory for the block sizes.\n", rank);
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+        splitText(totalChars, numProcs, opts.weights, counts, displs);
+        localChars = counts[rank];
+        localOffset = displs[rank];
+
+        // As for the padded split below, rank 0 views every block of the mapping and counts its own in place.
+        if (rank == 0 && opts.readMode == READ_MMAP) {
+            for (i = 1; i < numProcs; i++) mapView(&mapped, (fullText - mapped.text) + displs[i], counts[i]);
+            localText = (char *) mapView(&mapped, fullText - mapped.text, localChars);
+        } else
+            localText = (char *) malloc((localChars > 0 ? localChars : 1) * sizeof(char));
+
+        scatterTextV(fullText, localText, counts, displs, totalChars, rank, numProcs);
+
+        free(counts);
+        free(displs);
+        lapStart = lapPhase(&timers, PHASE_SCATTER, localChars, lapStart);
     } else {
-        // Calculate the number of characters per process. Note that only rank 0 has the correct value of totalChars
-        // (and hence charsPerproc) at this point. Also, we know by this point that totalChars is a multiple of numProcs.
-        if (rank == 0) charsPerProc = totalChars / numProcs;
-
-        MPI_Bcast(&charsPerProc, 1, MPI_INT, 0, MPI_COMM_WORLD);
-
-        // All ranks now know size to allocate
-        localText = (char *) malloc(charsPerProc * sizeof(char));
+        //
+        // Step 1. Dynamically allocate memory for each process
+        //
+
+        charsPerProc = broadcastCharsPerProc(totalChars, rank, numProcs, &coll, opts.collective);
+        lapStart = lapPhase(&timers, PHASE_BCAST, sizeof(long), lapStart);
+
+        // All ranks now know size to allocate. When mapped, rank 0 counts its own block directly from the
+        // mapping, so never holds a second copy of any of the text. Each rank's block is a view of whole pages
+        // (unless resuming from a checkpoint), and viewing them all first lets the kernel read them in ahead of
+        // the scatter.
+        if (rank == 0 && opts.readMode == READ_MMAP) {
+            for (i = 1; i < numProcs; i++) mapView(&mapped, (fullText - mapped.text) + i * charsPerProc, charsPerProc);
+            localText = (char *) mapView(&mapped, fullText - mapped.text, charsPerProc);
+        } else
+            localText = (char *) malloc(charsPerProc * sizeof(char));
+
+        //
+        // Step 2. Send global data out to each process
+        //
+
+        scatterText(fullText, localText, charsPerProc, rank, &coll, opts.collective);
+        localChars = charsPerProc;
+        localOffset = rank * charsPerProc;
+        lapStart = lapPhase(&timers, PHASE_SCATTER, localChars, lapStart);
     }
 
-    //
-    // Step 2. Send global data out to each process
-    //
-
-    MPI_Scatter(
-            fullText, charsPerProc, MPI_CHAR,
-            localText, charsPerProc, MPI_CHAR,
-            0, MPI_COMM_WORLD
-    );
-
     //
     // Step 3. Perform counts on local data
     //
 
-    for (i = 0; i < charsPerProc; i++)
-        if ((lc = letterCodeForChar(localText[i])) != -1)
-            localHist[lc]++;
+    if (localText != NULL) {
+        countLettersParallel(localText, localChars, opts.numThreads, localHist);
+        lapStart = lapPhase(&timers, PHASE_COUNT, localChars, lapStart);
+    }
 
     //
     // Step 4. Send all local histograms back to rank 0, which calculates total
     //
 
-    MPI_Reduce(&localHist, &globalHist, MAX_LETTERS, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+    collReduce(&localHist, &globalHist, MAX_LETTERS, MPI_INT, MPI_SUM, &coll, opts.collective);
+    lapPhase(&timers, PHASE_REDUCE, sizeof(localHist), lapStart);
+
+    // Add the counts from before the checkpoint.
+    if (rank == 0 && opts.checkpoint != NULL)
+        for (i = 0; i < MAX_LETTERS; i++) globalHist[i] += checkpoint.hist[i];
 
     //
     // Your solution will primarily go here, although dynamic memory allocation and freeing may go elsewhere.
@@ -144,20 +840,87 @@ int main(int argc, char **argv) {
     if (rank == 0)
         printf("Distribution, local calculation and reduction took a total time: %g s\n", MPI_Wtime() - startTime);
 
+    if (opts.shardPrefix != NULL) {
+        lapStart = MPI_Wtime();
+        // Rank 0's shard also carries the counts from before the checkpoint, which no rank counted this time.
+        saveLetterShard(opts.shardPrefix, rank, localHist,
+                        (rank == 0 && opts.checkpoint != NULL) ? checkpoint.hist : NULL);
+        lapPhase(&timers, PHASE_SAVE, sizeof(localHist), lapStart);
+    }
+
+    //
+    // Optionally count the generalised buckets from the same blocks, timed separately. Padding is not part of
+    // the file, so only bytes before the end of the file are counted.
+    //
+    BucketHist bucketHist;
+    if (opts.buckets.kind != BUCKET_NONE) {
+        long fileChars = 0;
+        struct stat fileStatus;
+        if (rank == 0 && stat(opts.fname, &fileStatus) == 0) fileChars = (long) fileStatus.st_size;
+        MPI_Bcast(&fileChars, 1, MPI_LONG, 0, MPI_COMM_WORLD);
+
+        long validChars = fileChars - localOffset;
+        if (validChars < 0) validChars = 0;
+        if (validChars > localChars) validChars = localChars;
+
+        if (bucketHistInit(&bucketHist, &opts.buckets) == -1) MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+
+        double bucketStartTime = MPI_Wtime();
+        countBucketsDistributed(&opts.buckets, localText, localChars, validChars, rank, numProcs, &bucketHist);
+        double bucketTime = MPI_Wtime() - bucketStartTime;
+
+        // Each rank's shard holds its own buckets, so is written before they are reduced, outside the timing.
+        if (opts.shardPrefix != NULL) {
+            lapStart = MPI_Wtime();
+            saveBucketShard(opts.shardPrefix, rank, &opts.buckets, &bucketHist);
+            lapPhase(&timers, PHASE_SAVE, 0, lapStart);
+        }
+
+        bucketStartTime = MPI_Wtime();
+        reduceBucketHist(&bucketHist, &opts.buckets, rank);
+        bucketTime += MPI_Wtime() - bucketStartTime;
+
+        if (rank == 0)
+            printf("Counting and reducing %lu possible buckets took a total time: %g s\n",
+                   (unsigned long) opts.buckets.numBuckets, bucketTime);
+    }
+
     //
     // Check against the serial calculation (rank 0 only).
     //
     if (rank == 0) {
         printf("\nChecking final histogram against the serial calculation.\n");
 
+        // With MPI-IO rank 0 never read the whole file, so map it now, outside the timing. With a checkpoint only
+        // the end of the file was counted, but the histogram is for all of it.
+        char *checkText = fullText;
+        long checkChars = totalChars;
+        if (opts.checkpoint != NULL) {
+            checkText = mapped.text;
+            checkChars = mapped.size;
+        }
+        MappedText checkMapped;
+        if (opts.readMode == READ_MPIIO) {
+            checkText = NULL;
+            checkChars = 0;
+            if (mapText(opts.fname, 1, &checkMapped) == 0) {
+                checkText = checkMapped.text;
+                checkChars = checkMapped.size;
+            }
+        }
+
         // Initialise the serial check histogram.
         int serialHist[MAX_LETTERS];
         for (i = 0; i < MAX_LETTERS; i++) serialHist[i] = 0;
 
         // Construct the serial histogram as per the parallel version, but over the whole text.
-        for (i = 0; i < totalChars; i++)
-            if ((lc = letterCodeForChar(fullText[i])) != -1)
-                serialHist[lc]++;
+        if (opts.corpus != NULL || opts.progress != NULL) {
+            countCorpusSerial(&corpus, serialHist);
+        } else {
+            for (j = 0; j < checkChars; j++)
+                if ((lc = letterCodeForChar(checkText[j])) != -1)
+                    serialHist[lc]++;
+        }
 
         // Check for errors (i.e. differences to the serial calculation).
         int errorFound = 0;
@@ -171,18 +934,60 @@ int main(int argc, char **argv) {
             printf("- at least one error found when checking against the serial calculation.\n");
         else
             printf(" - globalHist has the same values as the serial check.\n");
+
+        if (opts.buckets.kind != BUCKET_NONE) {
+            BucketHist serialBuckets;
+            if (bucketHistInit(&serialBuckets, &opts.buckets) == 0) {
+                long fileChars = (opts.readMode == READ_MPIIO ? checkChars : 0);
+                struct stat fileStatus;
+                if (opts.readMode != READ_MPIIO && stat(opts.fname, &fileStatus) == 0) fileChars = (long) fileStatus.st_size;
+
+                countBuckets(&opts.buckets, checkText, 0, fileChars, fileChars, &serialBuckets);
+                if (bucketHistsEqual(&opts.buckets, &bucketHist, &serialBuckets))
+                    printf(" - the bucket histogram has the same values as the serial check.\n");
+                else
+                    printf("- the bucket histogram differs from the serial calculation.\n");
+                bucketHistFree(&serialBuckets);
+            }
+        }
+
+        if (opts.readMode == READ_MPIIO && checkText != NULL) unmapText(&checkMapped);
     }
 
     //
     // Clear up and quit.
     //
     if (rank == 0) {
+        lapStart = MPI_Wtime();
         saveHist(globalHist, MAX_LETTERS);            // Defined in cwk2_extras.h; do not change or replace the call.
-        free(fullText);
+        if (opts.buckets.kind != BUCKET_NONE) saveBuckets(&opts.buckets, &bucketHist, BUCKETS_FILE);
+        if (opts.checkpoint != NULL) saveCheckpoint(opts.checkpoint, opts.fname, &mapped, globalHist);
+        lapPhase(&timers, PHASE_SAVE, sizeof(globalHist), lapStart);
+    }
+
+    // Report the phases, with the settings that identify this run in the CSV file.
+    char csvFields[256];
+    snprintf(csvFields, sizeof(csvFields), "%d,%d,%s,%s,%s,%ld", numProcs, opts.numThreads, readNames[opts.readMode],
+             splitNames[opts.split], collNames[opts.collective], opts.chunkSize);
+    reportPhaseTimers(&timers, rank, numProcs, opts.timingFile, "ranks,threads,read,split,coll,chunk", csvFields);
+
+    if (rank == 0) {
+        if (opts.readMode == READ_MMAP || opts.readMode == READ_SHARED)
+            unmapText(&mapped);
+        else if (opts.readMode == READ_TEXT)
+            free(fullText);
     }
-    if (rank > 0) {
+    if (sharedWin != MPI_WIN_NULL) {
+        MPI_Win_unlock_all(sharedWin);
+        MPI_Win_free(&sharedWin);
+    } else if (localText != fullText) {
         free(localText);
     }
+    if (opts.buckets.kind != BUCKET_NONE) bucketHistFree(&bucketHist);
+    freeCorpus(&corpus);
+    if (rank == 0 && opts.progress != NULL) closeProgress(&progress);
+    free(opts.weights);
+    collFree(&coll);
 
     MPI_Finalize();
     return EXIT_SUCCESS;
@@ -0,0 +1,547 @@
+//
+// Generalised histograms for cwk2.c, counting other kinds of bucket than single letters: every byte value,
+// UTF-8 code points, or k-grams of consecutive letters. Needs mpi.h, and letterTable[] from cwk2_count.h.
+//
+// A bucket is counted by the rank its first byte falls in, so a unit that straddles the end of a block
+// reads a few bytes (the halo) from the start of the following blocks. Small bucket spaces are dense arrays
+// reduced with MPI_SUM; large ones are sparse hash tables, merged as sorted runs up a binomial tree.
+//
+
+#include <stdint.h>
+
+
+//
+// Kinds of bucket:
+// BUCKET_BYTES - each of the 256 byte values.
+// BUCKET_UTF8  - Unicode code points. Malformed and overlong sequences count as U+FFFD, one per lead
+//                byte; continuation bytes that are not part of a valid sequence are ignored.
+// BUCKET_KGRAM - runs of k consecutive letters, case insensitive, so k=1 is the letter histogram.
+//
+#define BUCKET_NONE  0
+#define BUCKET_BYTES 1
+#define BUCKET_UTF8  2
+#define BUCKET_KGRAM 3
+
+// The longest k-gram, so 26^k fits in 64 bits.
+#define MAX_KGRAM 13
+
+// Bucket spaces up to this size are counted in a dense array; larger ones in a hash table.
+#define DENSE_BUCKET_LIMIT (1L << 20)
+
+// Code point used for malformed UTF-8.
+#define UTF8_REPLACEMENT 0xFFFD
+
+// Tag for the messages of the sparse reduction, distinct from those of the collectives in cwk2_coll.h and the
+// work pool in cwk2_corpus.h.
+#define BUCKET_TAG 2
+
+// Most entries sent in one message of the sparse reduction, so the count of 64-bit words fits in an int.
+#define BUCKET_ROUND (1L << 26)
+
+
+typedef struct {
+    int kind;               // One of the BUCKET_... codes.
+    int k;                  // Length of each gram for BUCKET_KGRAM.
+    uint64_t numBuckets;    // Number of possible buckets.
+    int halo;               // Most bytes a bucket can extend past its first byte.
+} BucketSpec;
+
+// One slot of a sparse histogram. The key is stored plus one, so a zero key marks an empty slot.
+typedef struct {
+    uint64_t key;
+    uint64_t count;
+} HistEntry;
+
+// Exactly one of dense and entries is used, depending on the size of the bucket space.
+typedef struct {
+    long *dense;            // numBuckets counts, or NULL.
+    HistEntry *entries;     // Hash table with a power-of-2 capacity, or NULL.
+    long capacity;
+    long used;              // Occupied slots, kept below half the capacity.
+} BucketHist;
+
+
+// Parses "bytes", "utf8", "letters" or "kgram:K". Returns 0 if okay, -1 if not.
+int parseBucketSpec(const char *s, BucketSpec *spec) {
+    spec->k = 1;
+    spec->halo = 0;
+
+    if (!strcmp(s, "bytes")) {
+        spec->kind = BUCKET_BYTES;
+        spec->numBuckets = 256;
+    } else if (!strcmp(s, "utf8")) {
+        spec->kind = BUCKET_UTF8;
+        spec->numBuckets = 0x110000;
+        spec->halo = 3;
+    } else if (!strcmp(s, "letters") || !strncmp(s, "kgram:", 6)) {
+        spec->kind = BUCKET_KGRAM;
+        if (s[0] == 'k') spec->k = atoi(s + 6);
+        if (spec->k < 1 || spec->k > MAX_KGRAM) return -1;
+
+        int i;
+        for (spec->numBuckets = 1, i = 0; i < spec->k; i++) spec->numBuckets *= MAX_LETTERS;
+        spec->halo = spec->k - 1;
+    } else {
+        return -1;
+    }
+
+    return 0;
+}
+
+
+//
+// Histogram storage.
+//
+
+// Returns 0 if okay, -1 after printing a message if memory could not be allocated.
+int bucketHistInit(BucketHist *h, const BucketSpec *spec) {
+    h->dense = NULL;
+    h->entries = NULL;
+    h->capacity = 0;
+    h->used = 0;
+
+    if (spec->numBuckets <= DENSE_BUCKET_LIMIT) {
+        h->dense = (long *) calloc(spec->numBuckets, sizeof(long));
+        if (h->dense == NULL) {
+            printf("Could not allocate memory for the bucket histogram.\n");
+            return -1;
+        }
+    } else {
+        h->capacity = 1024;
+        h->entries = (HistEntry *) calloc(h->capacity, sizeof(HistEntry));
+        if (h->entries == NULL) {
+            printf("Could not allocate memory for the bucket histogram.\n");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void bucketHistFree(BucketHist *h) {
+    free(h->dense);
+    free(h->entries);
+    h->dense = NULL;
+    h->entries = NULL;
+}
+
+// Mixes the bits of a key, so that consecutive keys spread over the table.
+uint64_t hashBucketKey(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+// Adds count to the slot for the stored (plus one) key in a table with a power-of-2 capacity, claiming a
+// slot if there is none. Returns 1 if a slot was claimed, 0 if not.
+int addToEntries(HistEntry *entries, long capacity, uint64_t storedKey, uint64_t count) {
+    long slot = (long) (hashBucketKey(storedKey) & (uint64_t) (capacity - 1));
+
+    while (entries[slot].key != 0 && entries[slot].key != storedKey) slot = (slot + 1) & (capacity - 1);
+
+    int claimed = (entries[slot].key == 0);
+    entries[slot].key = storedKey;
+    entries[slot].count += count;
+    return claimed;
+}
+
+// Moves a sparse histogram into a table of the given power-of-2 capacity. Returns 0 if okay, -1 after
+// printing a message if not.
+int resizeBucketHist(BucketHist *h, long capacity) {
+    HistEntry *entries = (HistEntry *) calloc(capacity, sizeof(HistEntry));
+    if (entries == NULL) {
+        printf("Could not allocate memory for the bucket histogram.\n");
+        return -1;
+    }
+
+    long slot;
+    for (slot = 0; slot < h->capacity; slot++)
+        if (h->entries[slot].key != 0)
+            addToEntries(entries, capacity, h->entries[slot].key, h->entries[slot].count);
+
+    free(h->entries);
+    h->entries = entries;
+    h->capacity = capacity;
+    return 0;
+}
+
+void addToBucket(BucketHist *h, uint64_t key) {
+    if (h->dense != NULL) {
+        h->dense[key]++;
+        return;
+    }
+
+    // Doubling at half full keeps probe sequences short. Running out of memory here is fatal.
+    if (2 * (h->used + 1) > h->capacity && resizeBucketHist(h, 2 * h->capacity) == -1)
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+
+    h->used += addToEntries(h->entries, h->capacity, key + 1, 1);
+}
+
+int compareHistEntries(const void *a, const void *b) {
+    uint64_t keyA = ((const HistEntry *) a)->key, keyB = ((const HistEntry *) b)->key;
+    return (keyA > keyB) - (keyA < keyB);
+}
+
+// Returns a newly allocated array of the non-empty buckets in order of key (not plus one), setting their
+// number, or NULL if there was not enough memory.
+HistEntry *collectBuckets(const BucketHist *h, const BucketSpec *spec, long *numEntries) {
+    long limit = (h->dense != NULL ? (long) spec->numBuckets : h->capacity), slot, n = 0;
+    HistEntry *entries = (HistEntry *) malloc((limit > 0 ? limit : 1) * sizeof(HistEntry));
+    if (entries == NULL) return NULL;
+
+    for (slot = 0; slot < limit; slot++) {
+        if (h->dense != NULL && h->dense[slot] != 0) {
+            entries[n].key = slot;
+            entries[n++].count = h->dense[slot];
+        } else if (h->dense == NULL && h->entries[slot].key != 0) {
+            entries[n].key = h->entries[slot].key - 1;
+            entries[n++].count = h->entries[slot].count;
+        }
+    }
+
+    if (h->dense == NULL) qsort(entries, n, sizeof(HistEntry), compareHistEntries);
+
+    *numEntries = n;
+    return entries;
+}
+
+
+//
+// Counting.
+//
+
+// Decodes the UTF-8 sequence whose lead byte is at bytes[i], reading nothing at or beyond 'available'.
+// Sets the code point, and returns the number of bytes it used; malformed sequences use only the lead byte.
+int decodeUTF8(const unsigned char *bytes, long i, long available, uint64_t *codePoint) {
+    unsigned char lead = bytes[i];
+    int length, j;
+    uint64_t cp, minimum;
+
+    if (lead < 0x80) {
+        *codePoint = lead;
+        return 1;
+    }
+
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        length = 2;
+        cp = lead & 0x1F;
+        minimum = 0x80;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        length = 3;
+        cp = lead & 0x0F;
+        minimum = 0x800;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        length = 4;
+        cp = lead & 0x07;
+        minimum = 0x10000;
+    } else {
+        *codePoint = UTF8_REPLACEMENT;
+        return 1;
+    }
+
+    for (j = 1; j < length; j++) {
+        if (i + j >= available || (bytes[i + j] & 0xC0) != 0x80) {
+            *codePoint = UTF8_REPLACEMENT;
+            return 1;
+        }
+        cp = (cp << 6) | (bytes[i + j] & 0x3F);
+    }
+
+    // Overlong encodings, surrogates and values beyond U+10FFFF are not valid code points.
+    if (cp < minimum || (cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF) {
+        *codePoint = UTF8_REPLACEMENT;
+        return 1;
+    }
+
+    *codePoint = cp;
+    return length;
+}
+
+// Adds every bucket whose first byte is in text[begin..limit-1] to the histogram, reading nothing at or
+// beyond text[available]. Returns where the next bucket after 'limit' could start, which is 'limit' except
+// for a UTF-8 sequence that runs past it.
+long countBuckets(const BucketSpec *spec, const char *text, long begin, long limit, long available, BucketHist *h) {
+    const unsigned char *bytes = (const unsigned char *) text;
+    long i = begin;
+
+    if (!letterTableReady) initLetterTable();
+
+    if (spec->kind == BUCKET_BYTES) {
+        for (; i < limit; i++) addToBucket(h, bytes[i]);
+    } else if (spec->kind == BUCKET_UTF8) {
+        while (i < limit) {
+            uint64_t codePoint;
+
+            // Stray continuation bytes either belong to a sequence started earlier, or are ignored.
+            if ((bytes[i] & 0xC0) == 0x80) {
+                i++;
+                continue;
+            }
+            i += decodeUTF8(bytes, i, available, &codePoint);
+            addToBucket(h, codePoint);
+        }
+    } else {
+        // Keep a rolling key of the last k letters, reset by any other character.
+        uint64_t key = 0;
+        long end = (limit + spec->k - 1 < available ? limit + spec->k - 1 : available);
+        int run = 0;
+
+        for (; i < end; i++) {
+            int code = letterTable[bytes[i]];
+
+            if (code == MAX_LETTERS) {
+                run = 0;
+                key = 0;
+                continue;
+            }
+
+            key = key % (spec->numBuckets / MAX_LETTERS) * MAX_LETTERS + code;
+            if (++run >= spec->k) addToBucket(h, key);
+        }
+        i = limit;
+    }
+
+    return i;
+}
+
+
+//
+// Distributed counting.
+//
+
+// Adds the buckets starting in this rank's valid characters localText[0..validChars-1] to the histogram,
+// where this rank's block has localChars characters and is followed in the text by the blocks of the
+// higher ranks. Must be called by all ranks, as the halo is gathered from the first characters of every block.
+void countBucketsDistributed(const BucketSpec *spec, const char *localText, long localChars, long validChars,
+                             int rank, int numProcs, BucketHist *h) {
+    int halo = spec->halo, r;
+    char *gathered = NULL;
+    int *shares = NULL, *offsets = NULL;
+
+    // Each rank shares its first characters. A block shorter than the halo is shared whole, so the shares
+    // of the following ranks are contiguous in the text and concatenating them is still correct.
+    if (halo > 0) {
+        int share = (int) (localChars < halo ? localChars : halo);
+
+        shares = (int *) malloc(numProcs * sizeof(int));
+        offsets = (int *) malloc(numProcs * sizeof(int));
+        gathered = (char *) malloc(numProcs * halo * sizeof(char));
+        if (shares == NULL || offsets == NULL || gathered == NULL) {
+            printf("Rank %d: Could not allocate memory for the halo.\n", rank);
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+
+        MPI_Allgather(&share, 1, MPI_INT, shares, 1, MPI_INT, MPI_COMM_WORLD);
+        for (offsets[0] = 0, r = 1; r < numProcs; r++) offsets[r] = offsets[r - 1] + shares[r - 1];
+        MPI_Allgatherv((void *) localText, share, MPI_CHAR, gathered, shares, offsets, MPI_CHAR, MPI_COMM_WORLD);
+    }
+
+    // Everything except the last 'halo' characters can be counted without the halo.
+    long split = (localChars > halo ? localChars - halo : 0);
+    if (split > validChars) split = validChars;
+    long next = countBuckets(spec, localText, 0, split, localChars, h);
+
+    if (next < validChars) {
+        // Stitch the end of this block to the start of the following ones.
+        long tailStart = split;
+        long tailLength = localChars - tailStart;
+        long haloLength = 0;
+        for (r = rank + 1; r < numProcs; r++) haloLength += shares[r];
+        if (haloLength > halo) haloLength = halo;
+
+        char *tail = (char *) malloc((tailLength + halo) * sizeof(char));
+        if (tail == NULL) {
+            printf("Rank %d: Could not allocate memory for the halo.\n", rank);
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+        memcpy(tail, localText + tailStart, tailLength);
+        if (haloLength > 0) memcpy(tail + tailLength, gathered + offsets[rank + 1], haloLength);
+
+        countBuckets(spec, tail, next - tailStart, validChars - tailStart, tailLength + haloLength, h);
+
+        free(tail);
+    }
+
+    free(gathered);
+    free(shares);
+    free(offsets);
+}
+
+// Sends n entries to another rank: their number, then the entries in rounds of up to BUCKET_ROUND.
+void sendBucketRun(const HistEntry *run, long n, int to) {
+    long done;
+
+    MPI_Send(&n, 1, MPI_LONG, to, BUCKET_TAG, MPI_COMM_WORLD);
+    for (done = 0; done < n; done += BUCKET_ROUND) {
+        long count = (n - done < BUCKET_ROUND ? n - done : BUCKET_ROUND);
+        MPI_Send((void *) (run + done), (int) (2 * count), MPI_UINT64_T, to, BUCKET_TAG, MPI_COMM_WORLD);
+    }
+}
+
+// Receives the entries sent by sendBucketRun() into a newly allocated array, setting their number.
+HistEntry *receiveBucketRun(int from, int rank, long *n) {
+    long done;
+
+    MPI_Recv(n, 1, MPI_LONG, from, BUCKET_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    HistEntry *run = (HistEntry *) malloc((*n > 0 ? *n : 1) * sizeof(HistEntry));
+    if (run == NULL) {
+        printf("Rank %d: Could not allocate memory for %ld buckets from rank %d.\n", rank, *n, from);
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+
+    for (done = 0; done < *n; done += BUCKET_ROUND) {
+        long count = (*n - done < BUCKET_ROUND ? *n - done : BUCKET_ROUND);
+        MPI_Recv(run + done, (int) (2 * count), MPI_UINT64_T, from, BUCKET_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    }
+
+    return run;
+}
+
+// Merges two runs of entries sorted by key into a newly allocated one, adding the counts of equal keys. Returns
+// it, setting its length, or NULL if there was not enough memory.
+HistEntry *mergeBucketRuns(const HistEntry *a, long numA, const HistEntry *b, long numB, long *numMerged) {
+    HistEntry *merged = (HistEntry *) malloc((numA + numB > 0 ? numA + numB : 1) * sizeof(HistEntry));
+    long i = 0, j = 0, n = 0;
+    if (merged == NULL) return NULL;
+
+    while (i < numA && j < numB) {
+        if (a[i].key < b[j].key) {
+            merged[n++] = a[i++];
+        } else if (b[j].key < a[i].key) {
+            merged[n++] = b[j++];
+        } else {
+            merged[n].key = a[i].key;
+            merged[n++].count = a[i++].count + b[j++].count;
+        }
+    }
+    while (i < numA) merged[n++] = a[i++];
+    while (j < numB) merged[n++] = b[j++];
+
+    *numMerged = n;
+    return merged;
+}
+
+// Sums every rank's histogram into rank 0's, leaving the others' undefined. Must be called by all ranks.
+//
+// A sparse table is sent as the sorted run of its occupied entries, so each message is the size of what the
+// sender holds rather than of the merged table. The runs are merged up a binomial tree: in round 'mask', the
+// ranks with that bit set send to the rank without it and drop out, and the receivers merge what they get into
+// their own run. Rank 0 ends up with the whole run, and rebuilds its table from it.
+void reduceBucketHist(BucketHist *h, const BucketSpec *spec, int rank) {
+    if (h->dense != NULL) {
+        MPI_Reduce(rank == 0 ? MPI_IN_PLACE : h->dense, rank == 0 ? h->dense : NULL, (int) spec->numBuckets,
+                   MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+        return;
+    }
+
+    int numProcs, mask;
+    MPI_Comm_size(MPI_COMM_WORLD, &numProcs);
+
+    long n;
+    HistEntry *run = collectBuckets(h, spec, &n);
+    if (run == NULL) {
+        printf("Rank %d: Could not allocate memory for the sorted buckets.\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+
+    for (mask = 1; mask < numProcs; mask <<= 1) {
+        if (rank & mask) {
+            sendBucketRun(run, n, rank - mask);
+            break;
+        }
+        if (rank + mask < numProcs) {
+            long numIncoming, numMerged;
+            HistEntry *incoming = receiveBucketRun(rank + mask, rank, &numIncoming);
+            HistEntry *merged = mergeBucketRuns(run, n, incoming, numIncoming, &numMerged);
+            if (merged == NULL) {
+                printf("Rank %d: Could not allocate memory for merging %ld buckets.\n", rank, n + numIncoming);
+                MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+            }
+            free(run);
+            free(incoming);
+            run = merged;
+            n = numMerged;
+        }
+    }
+
+    // Rebuild rank 0's table from the merged run, below half full as addToBucket() keeps it.
+    if (rank == 0) {
+        long capacity = 1024, i;
+        while (capacity < 2 * n) capacity *= 2;
+
+        HistEntry *entries = (HistEntry *) calloc(capacity, sizeof(HistEntry));
+        if (entries == NULL) {
+            printf("Could not allocate memory for the bucket histogram.\n");
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+        for (i = 0; i < n; i++) addToEntries(entries, capacity, run[i].key + 1, run[i].count);
+
+        free(h->entries);
+        h->entries = entries;
+        h->capacity = capacity;
+        h->used = n;
+    }
+
+    free(run);
+}
+
+
+//
+// Output.
+//
+
+// Writes the bucket's name, which is the byte value, the code point as U+XXXX, or the letters of the gram.
+void formatBucketKey(const BucketSpec *spec, uint64_t key, char *name) {
+    int i;
+
+    if (spec->kind == BUCKET_BYTES) {
+        sprintf(name, "%d", (int) key);
+    } else if (spec->kind == BUCKET_UTF8) {
+        sprintf(name, "U+%04X", (unsigned int) key);
+    } else {
+        for (i = spec->k - 1; i >= 0; i--, key /= MAX_LETTERS) name[i] = (char) ('a' + key % MAX_LETTERS);
+        name[spec->k] = '\0';
+    }
+}
+
+// Saves the non-empty buckets, one "name count" per line in order of key. Returns 0 if okay, -1 if not.
+int saveBuckets(const BucketSpec *spec, const BucketHist *h, const char *fname) {
+    long n, i;
+    HistEntry *entries = collectBuckets(h, spec, &n);
+    FILE *file = fopen(fname, "w");
+
+    if (entries == NULL || file == NULL) {
+        printf("Could not save the bucket histogram to '%s'.\n", fname);
+        free(entries);
+        if (file != NULL) fclose(file);
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        char name[MAX_KGRAM + 1];
+        formatBucketKey(spec, entries[i].key, name);
+        fprintf(file, "%s %lu\n", name, (unsigned long) entries[i].count);
+    }
+
+    fclose(file);
+    free(entries);
+    return 0;
+}
+
+// Returns 1 if both histograms have the same non-empty buckets with the same counts, 0 if not.
+int bucketHistsEqual(const BucketSpec *spec, const BucketHist *a, const BucketHist *b) {
+    long numA, numB, i;
+    HistEntry *entriesA = collectBuckets(a, spec, &numA), *entriesB = collectBuckets(b, spec, &numB);
+    int equal = (entriesA != NULL && entriesB != NULL && numA == numB);
+
+    for (i = 0; equal && i < numA; i++)
+        if (entriesA[i].key != entriesB[i].key || entriesA[i].count != entriesB[i].count) equal = 0;
+
+    free(entriesA);
+    free(entriesB);
+    return equal;
+}
@@ -0,0 +1,114 @@
+//
+// Checkpoints for cwk2.c, so a file that is only ever appended to can be histogrammed incrementally. The
+// checkpoint holds the histogram as saveHist() writes it, plus how much of the file it covers, the file's
+// modification time and a hash of the bytes just before the end of the covered part. A rerun then only counts
+// what has been appended since. Needs MAX_LETTERS, and mapText() from cwk2_io.h.
+//
+
+#include <sys/stat.h>
+
+
+// Format version, written on the first line.
+#define CHECKPOINT_VERSION 2
+
+// Bytes before the end of the covered part that are hashed, to catch a file rewritten rather than appended to.
+#define CHECKPOINT_TAIL 4096
+
+
+typedef struct {
+    long offset;                // Bytes of the file the histogram covers.
+    long mtime;                 // Modification time of the file in nanoseconds when saved.
+    unsigned long long hash;    // Hash of the CHECKPOINT_TAIL bytes (or fewer) before offset.
+    int hist[MAX_LETTERS];      // Histogram of bytes [0, offset).
+} Checkpoint;
+
+
+// FNV-1a hash of the bytes just before offset.
+unsigned long long hashCheckpointTail(const char *text, long offset) {
+    unsigned long long hash = 14695981039346656037ULL;
+    long j;
+
+    for (j = (offset > CHECKPOINT_TAIL ? offset - CHECKPOINT_TAIL : 0); j < offset; j++) {
+        hash ^= (unsigned char) text[j];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+// Returns the modification time of the file in nanoseconds, as for the progress log in cwk2_corpus.h, so an
+// edit within the same second is still seen. Returns -1 if the file cannot be found.
+long fileModificationTime(const char *fname) {
+    struct stat fileStatus;
+    if (stat(fname, &fileStatus) != 0) return -1;
+    return (long) fileStatus.st_mtim.tv_sec * 1000000000L + (long) fileStatus.st_mtim.tv_nsec;
+}
+
+// Loads the checkpoint for fname, whose current contents are mapped, and returns the number of bytes it covers:
+// where counting should resume. Returns 0 with an empty histogram if there is no usable checkpoint, printing
+// why if one exists but does not match the file.
+long loadCheckpoint(const char *ckptName, const char *fname, const MappedText *mapped, Checkpoint *ckpt) {
+    int i, version, code;
+    char savedName[4096];
+
+    for (i = 0; i < MAX_LETTERS; i++) ckpt->hist[i] = 0;
+    ckpt->offset = 0;
+
+    FILE *file = fopen(ckptName, "r");
+    if (file == NULL) return 0;
+
+    int okay = (fscanf(file, "cwk2 checkpoint %d\n", &version) == 1 && version == CHECKPOINT_VERSION &&
+                fgets(savedName, sizeof(savedName), file) != NULL &&
+                fscanf(file, "%ld %ld %llx", &ckpt->offset, &ckpt->mtime, &ckpt->hash) == 3);
+    for (i = 0; okay && i < MAX_LETTERS; i++)
+        okay = (fscanf(file, "%d %d", &code, &ckpt->hist[i]) == 2 && code == i);
+    fclose(file);
+
+    savedName[strcspn(savedName, "\n")] = '\0';
+    if (!okay) {
+        printf("Checkpoint '%s' could not be read; counting all of '%s'.\n", ckptName, fname);
+    } else if (strcmp(savedName, fname)) {
+        printf("Checkpoint '%s' is for '%s', not '%s'; counting all of it.\n", ckptName, savedName, fname);
+        okay = 0;
+    } else if (ckpt->offset > mapped->size || hashCheckpointTail(mapped->text, ckpt->offset) != ckpt->hash ||
+               (ckpt->offset == mapped->size && ckpt->mtime != fileModificationTime(fname))) {
+        // Shorter, different where the checkpoint ended, or the same size but modified since: not an append.
+        printf("'%s' has changed other than by appending since checkpoint '%s'; counting all of it.\n", fname,
+               ckptName);
+        okay = 0;
+    }
+
+    if (!okay) {
+        for (i = 0; i < MAX_LETTERS; i++) ckpt->hist[i] = 0;
+        ckpt->offset = 0;
+    }
+
+    return ckpt->offset;
+}
+
+// Saves the checkpoint for the whole of the mapped file with its histogram. Returns 0 if okay, -1 after printing
+// an error message if not. Written to a temporary file first and then renamed, so a failed run never leaves a
+// partial checkpoint.
+int saveCheckpoint(const char *ckptName, const char *fname, const MappedText *mapped, const int *hist) {
+    char tmpName[4096];
+    int i;
+
+    snprintf(tmpName, sizeof(tmpName), "%s.tmp", ckptName);
+    FILE *file = fopen(tmpName, "w");
+    if (file == NULL) {
+        printf("Could not open the checkpoint '%s' for output.\n", tmpName);
+        return -1;
+    }
+
+    fprintf(file, "cwk2 checkpoint %d\n%s\n", CHECKPOINT_VERSION, fname);
+    fprintf(file, "%ld %ld %llx\n", mapped->size, fileModificationTime(fname),
+            hashCheckpointTail(mapped->text, mapped->size));
+    for (i = 0; i < MAX_LETTERS; i++) fprintf(file, "%d %d\n", i, hist[i]);
+
+    if (fclose(file) || rename(tmpName, ckptName)) {
+        printf("Could not save the checkpoint '%s'.\n", ckptName);
+        return -1;
+    }
+
+    return 0;
+}
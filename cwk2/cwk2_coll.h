@@ -0,0 +1,537 @@
+//
+// A small collectives layer for cwk2.c, with broadcast, scatter and reduce rooted at rank 0 of
+// MPI_COMM_WORLD, for any number of ranks. Needs mpi.h.
+//
+// Each collective has three algorithms besides the library's own:
+// COLL_BINOMIAL - a binomial tree, taking ceil(log2 p) steps; best for small messages.
+// COLL_CHAIN    - a pipelined chain, sending segments along the ranks in turn so every link is busy; best
+//                 for large broadcasts and reductions. For scatter, rank 0 sends every block directly.
+// COLL_TWOLEVEL - between one leader per node, then within each node over shared memory, with the ranks of
+//                 each node found by MPI_Comm_split_type(MPI_COMM_TYPE_SHARED).
+// COLL_AUTO picks one from a latency-bandwidth model of each algorithm, using the latency and bandwidth
+// measured within and between nodes by collInit().
+//
+// Broadcast and reduce assume a contiguous datatype, and reduce a commutative operation.
+//
+
+
+//
+// Algorithms.
+//
+#define COLL_AUTO     0
+#define COLL_NATIVE   1
+#define COLL_BINOMIAL 2
+#define COLL_CHAIN    3
+#define COLL_TWOLEVEL 4
+
+const char *collNames[] = {"auto", "native", "binomial", "chain", "twolevel"};
+#define COLL_NUM_ALGORITHMS 5
+
+// Kinds of collective, for choosing the algorithm.
+#define COLL_BCAST   0
+#define COLL_SCATTER 1
+#define COLL_REDUCE  2
+
+// Size in bytes of each segment sent along a chain.
+#define COLL_SEGMENT (64L * 1024)
+
+// Scatters above this many bytes in total avoid the binomial tree, whose inner ranks buffer half the data.
+#define COLL_TREE_SCATTER_LIMIT (64L * 1024 * 1024)
+
+// Round trips per message size when measuring the network.
+#define COLL_PING_REPEATS 20
+#define COLL_PING_LARGE (1L << 20)
+
+
+typedef struct {
+    MPI_Comm node;          // The ranks on this rank's node, in the same order as in MPI_COMM_WORLD.
+    MPI_Comm leaders;       // The first rank of every node; MPI_COMM_NULL on the others.
+    int rank, numProcs;
+    int nodeRank, nodeSize, maxNodeSize, numNodes;
+    int contiguous;         // Whether every node's ranks are consecutive, which two-level scatter needs.
+    int *nodeOf;            // Node of every world rank, numbered in order of their leaders.
+    int *nodeFirst;         // First world rank of each node, which is its leader.
+    int *nodeCount;         // Number of ranks on each node.
+    double alphaIntra, betaIntra;   // Measured latency (s) and time per byte (s) within a node,
+    double alphaInter, betaInter;   // and between nodes. The same on all ranks.
+} Collectives;
+
+
+//
+// Set up.
+//
+
+// Times COLL_PING_REPEATS round trips of the given size between ranks a and b, returning the one-way time
+// per message on rank a and 0 elsewhere.
+double pingPong(int a, int b, char *buffer, int bytes, int rank) {
+    double start = MPI_Wtime();
+    int i;
+
+    for (i = 0; i < COLL_PING_REPEATS; i++) {
+        if (rank == a) {
+            MPI_Send(buffer, bytes, MPI_CHAR, b, 0, MPI_COMM_WORLD);
+            MPI_Recv(buffer, bytes, MPI_CHAR, b, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        } else if (rank == b) {
+            MPI_Recv(buffer, bytes, MPI_CHAR, a, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            MPI_Send(buffer, bytes, MPI_CHAR, a, 0, MPI_COMM_WORLD);
+        }
+    }
+
+    return (rank == a ? (MPI_Wtime() - start) / (2 * COLL_PING_REPEATS) : 0.0);
+}
+
+// Measures the latency and time per byte between rank 0 and 'peer', or leaves them unchanged if there is
+// no peer (-1). Must be called by all ranks.
+void measureLink(int peer, int rank, double *alpha, double *beta) {
+    if (peer < 0) return;
+
+    double params[2] = {*alpha, *beta};
+    if (rank == 0 || rank == peer) {
+        char *buffer = (char *) calloc(COLL_PING_LARGE, sizeof(char));
+        if (buffer == NULL) {
+            printf("Rank %d: Could not allocate memory for measuring the network.\n", rank);
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+
+        double small = pingPong(0, peer, buffer, 8, rank);
+        double large = pingPong(0, peer, buffer, (int) COLL_PING_LARGE, rank);
+
+        params[0] = small;
+        params[1] = (large > small ? (large - small) / COLL_PING_LARGE : 0.0);
+        free(buffer);
+    }
+    MPI_Bcast(params, 2, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+    *alpha = params[0];
+    *beta = params[1];
+}
+
+// Finds the nodes and measures the links within and between them. Must be called by all ranks.
+void collInit(Collectives *coll) {
+    int r;
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &coll->rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &coll->numProcs);
+
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, coll->rank, MPI_INFO_NULL, &coll->node);
+    MPI_Comm_rank(coll->node, &coll->nodeRank);
+    MPI_Comm_size(coll->node, &coll->nodeSize);
+
+    MPI_Comm_split(MPI_COMM_WORLD, coll->nodeRank == 0 ? 0 : MPI_UNDEFINED, coll->rank, &coll->leaders);
+
+    // Number the nodes by their leaders, and tell every rank which node every other rank is on.
+    int nodeIndex = 0;
+    if (coll->leaders != MPI_COMM_NULL) MPI_Comm_rank(coll->leaders, &nodeIndex);
+    MPI_Bcast(&nodeIndex, 1, MPI_INT, 0, coll->node);
+
+    int *nodeOf = coll->nodeOf = (int *) malloc(coll->numProcs * sizeof(int));
+    coll->nodeFirst = (int *) malloc(coll->numProcs * sizeof(int));
+    coll->nodeCount = (int *) calloc(coll->numProcs, sizeof(int));
+    if (nodeOf == NULL || coll->nodeFirst == NULL || coll->nodeCount == NULL) {
+        printf("Rank %d: Could not allocate memory for the node layout.\n", coll->rank);
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+    MPI_Allgather(&nodeIndex, 1, MPI_INT, nodeOf, 1, MPI_INT, MPI_COMM_WORLD);
+
+    coll->numNodes = 0;
+    coll->contiguous = 1;
+    for (r = 0; r < coll->numProcs; r++) {
+        if (coll->nodeCount[nodeOf[r]]++ == 0) {
+            coll->nodeFirst[nodeOf[r]] = r;
+            coll->numNodes++;
+        } else if (nodeOf[r - 1] != nodeOf[r]) {
+            coll->contiguous = 0;
+        }
+    }
+    for (coll->maxNodeSize = 0, r = 0; r < coll->numNodes; r++)
+        if (coll->nodeCount[r] > coll->maxNodeSize) coll->maxNodeSize = coll->nodeCount[r];
+
+    // Rank 0 is its node's leader, so measure against another rank on node 0 and the leader of node 1.
+    // Without a second node, the links between nodes are taken to be the same as within one.
+    int intraPeer = -1, interPeer = (coll->numNodes > 1 ? coll->nodeFirst[1] : -1);
+    for (r = 1; r < coll->numProcs && intraPeer < 0; r++)
+        if (nodeOf[r] == 0) intraPeer = r;
+
+    coll->alphaIntra = coll->alphaInter = 1e-6;
+    coll->betaIntra = coll->betaInter = 1e-10;
+    measureLink(intraPeer, coll->rank, &coll->alphaIntra, &coll->betaIntra);
+    coll->alphaInter = coll->alphaIntra;
+    coll->betaInter = coll->betaIntra;
+    measureLink(interPeer, coll->rank, &coll->alphaInter, &coll->betaInter);
+}
+
+void collFree(Collectives *coll) {
+    MPI_Comm_free(&coll->node);
+    if (coll->leaders != MPI_COMM_NULL) MPI_Comm_free(&coll->leaders);
+    free(coll->nodeOf);
+    free(coll->nodeFirst);
+    free(coll->nodeCount);
+}
+
+
+//
+// Cost model. Each message of m bytes is taken to cost alpha + beta*m.
+//
+
+// Number of steps in a binomial tree over p ranks, i.e. log2(p) rounded up.
+int treeDepth(int p) {
+    int depth = 0;
+    while ((1 << depth) < p) depth++;
+    return depth;
+}
+
+// Predicted time for a broadcast or reduction of 'bytes' over p ranks with a binomial tree.
+double binomialCost(int p, double bytes, double alpha, double beta) {
+    return treeDepth(p) * (alpha + beta * bytes);
+}
+
+// Predicted time for a broadcast or reduction of 'bytes' over p ranks along a pipelined chain.
+double chainCost(int p, double bytes, double alpha, double beta) {
+    long segments = ((long) bytes + COLL_SEGMENT - 1) / COLL_SEGMENT;
+    if (segments < 1) segments = 1;
+    return (p > 1 ? (p - 2 + segments) * (alpha + beta * bytes / segments) : 0.0);
+}
+
+// Returns COLL_BINOMIAL or COLL_CHAIN, whichever is predicted to be faster for a broadcast or reduction.
+int fasterTree(int p, double bytes, double alpha, double beta) {
+    return (chainCost(p, bytes, alpha, beta) < binomialCost(p, bytes, alpha, beta) ? COLL_CHAIN : COLL_BINOMIAL);
+}
+
+double fasterTreeCost(int p, double bytes, double alpha, double beta) {
+    double binomial = binomialCost(p, bytes, alpha, beta), chain = chainCost(p, bytes, alpha, beta);
+    return (chain < binomial ? chain : binomial);
+}
+
+// Returns the algorithm predicted to be fastest for a collective of the given kind, where 'bytes' is the
+// whole message for broadcast and reduce, and one rank's block for scatter. The same on all ranks.
+int collChoose(const Collectives *coll, int kind, long bytes) {
+    int p = coll->numProcs;
+
+    // Without more than one node, or with a single rank per node, there is only one level.
+    int twoLevel = (coll->numNodes > 1 && coll->maxNodeSize > 1 && (kind != COLL_SCATTER || coll->contiguous));
+
+    if (kind == COLL_SCATTER) {
+        double flatCost = treeDepth(p) * coll->alphaInter + (p - 1) * coll->betaInter * bytes;
+        double twoLevelCost = (coll->numNodes - 1) * (coll->alphaInter + coll->betaInter * coll->maxNodeSize * bytes)
+                              + treeDepth(coll->maxNodeSize) * coll->alphaIntra
+                              + (coll->maxNodeSize - 1) * coll->betaIntra * bytes;
+
+        if (twoLevel && twoLevelCost < flatCost) return COLL_TWOLEVEL;
+        return ((double) bytes * p > COLL_TREE_SCATTER_LIMIT ? COLL_CHAIN : COLL_BINOMIAL);
+    }
+
+    int flat = fasterTree(p, bytes, coll->alphaInter, coll->betaInter);
+    double flatCost = fasterTreeCost(p, bytes, coll->alphaInter, coll->betaInter);
+    double twoLevelCost = fasterTreeCost(coll->numNodes, bytes, coll->alphaInter, coll->betaInter)
+                          + fasterTreeCost(coll->maxNodeSize, bytes, coll->alphaIntra, coll->betaIntra);
+
+    return (twoLevel && twoLevelCost < flatCost ? COLL_TWOLEVEL : flat);
+}
+
+
+//
+// Algorithms on one communicator, rooted at its rank 0.
+//
+
+// Number of elements of the datatype in one chain segment.
+int segmentCount(MPI_Datatype type) {
+    int size;
+    MPI_Type_size(type, &size);
+    return (COLL_SEGMENT / size > 0 ? (int) (COLL_SEGMENT / size) : 1);
+}
+
+void bcastBinomial(void *buf, int count, MPI_Datatype type, MPI_Comm comm) {
+    int rank, p, mask;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &p);
+
+    // Receive from the rank that differs in the lowest set bit, then send to ranks above in smaller steps.
+    for (mask = 1; mask < p; mask <<= 1) {
+        if (rank & mask) {
+            MPI_Recv(buf, count, type, rank - mask, 0, comm, MPI_STATUS_IGNORE);
+            break;
+        }
+    }
+    for (mask >>= 1; mask > 0; mask >>= 1)
+        if (rank + mask < p) MPI_Send(buf, count, type, rank + mask, 0, comm);
+}
+
+void bcastChain(void *buf, int count, MPI_Datatype type, MPI_Comm comm) {
+    int rank, p, offset, segment = segmentCount(type);
+    MPI_Aint lowerBound, extent;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &p);
+    MPI_Type_get_extent(type, &lowerBound, &extent);
+
+    for (offset = 0; offset < count; offset += segment) {
+        int len = (count - offset < segment ? count - offset : segment);
+        char *part = (char *) buf + (MPI_Aint) offset * extent;
+
+        if (rank > 0) MPI_Recv(part, len, type, rank - 1, 0, comm, MPI_STATUS_IGNORE);
+        if (rank < p - 1) MPI_Send(part, len, type, rank + 1, 0, comm);
+    }
+}
+
+// Reduces into recvbuf on rank 0, where sendbuf may be MPI_IN_PLACE.
+void reduceBinomial(const void *sendbuf, void *recvbuf, int count, MPI_Datatype type, MPI_Op op, MPI_Comm comm) {
+    int rank, p, mask, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &p);
+    MPI_Type_size(type, &size);
+
+    char *acc = (char *) malloc((long) count * size), *incoming = (char *) malloc((long) count * size);
+    if (acc == NULL || incoming == NULL) {
+        printf("Could not allocate memory for a reduction.\n");
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+    memcpy(acc, (rank == 0 && sendbuf == MPI_IN_PLACE ? recvbuf : sendbuf), (long) count * size);
+
+    // Gather from ranks above in increasing steps, then pass the partial result down and stop.
+    for (mask = 1; mask < p; mask <<= 1) {
+        if (rank & mask) {
+            MPI_Send(acc, count, type, rank - mask, 0, comm);
+            break;
+        }
+        if (rank + mask < p) {
+            MPI_Recv(incoming, count, type, rank + mask, 0, comm, MPI_STATUS_IGNORE);
+            MPI_Reduce_local(incoming, acc, count, type, op);
+        }
+    }
+
+    if (rank == 0) memcpy(recvbuf, acc, (long) count * size);
+    free(acc);
+    free(incoming);
+}
+
+// Reduces into recvbuf on rank 0 along a chain from the last rank, a segment at a time.
+void reduceChain(const void *sendbuf, void *recvbuf, int count, MPI_Datatype type, MPI_Op op, MPI_Comm comm) {
+    int rank, p, offset, size, segment = segmentCount(type);
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &p);
+    MPI_Type_size(type, &size);
+
+    const char *mine = (rank == 0 && sendbuf == MPI_IN_PLACE ? recvbuf : sendbuf);
+    char *acc = (char *) malloc((long) segment * size), *incoming = (char *) malloc((long) segment * size);
+    if (acc == NULL || incoming == NULL) {
+        printf("Could not allocate memory for a reduction.\n");
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+
+    for (offset = 0; offset < count; offset += segment) {
+        int len = (count - offset < segment ? count - offset : segment);
+
+        memcpy(acc, mine + (long) offset * size, (long) len * size);
+        if (rank < p - 1) {
+            MPI_Recv(incoming, len, type, rank + 1, 0, comm, MPI_STATUS_IGNORE);
+            MPI_Reduce_local(incoming, acc, len, type, op);
+        }
+
+        if (rank > 0)
+            MPI_Send(acc, len, type, rank - 1, 0, comm);
+        else
+            memcpy((char *) recvbuf + (long) offset * size, acc, (long) len * size);
+    }
+
+    free(acc);
+    free(incoming);
+}
+
+// Sends sendcount elements of sendtype per rank from rank 0's sendbuf, received as recvcount elements of
+// the contiguous recvtype. Rank 0's recvbuf may be MPI_IN_PLACE. Each rank receives the blocks of the ranks
+// it will forward to, up to the next multiple of its lowest set bit, so inner ranks buffer data in transit.
+void scatterBinomial(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                     void *recvbuf, int recvcount, MPI_Datatype recvtype, MPI_Comm comm) {
+    int rank, p, mask, span;
+    MPI_Aint lowerBound, sendExtent, recvExtent;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &p);
+    MPI_Type_get_extent(sendtype, &lowerBound, &sendExtent);
+    MPI_Type_get_extent(recvtype, &lowerBound, &recvExtent);
+
+    char *blocks = NULL;
+    if (rank == 0) {
+        for (span = 1; span < p; span <<= 1);
+    } else {
+        span = rank & -rank;
+        int have = (span < p - rank ? span : p - rank);
+
+        // A leaf receives its own block directly.
+        if (have == 1) {
+            MPI_Recv(recvbuf, recvcount, recvtype, rank - span, 0, comm, MPI_STATUS_IGNORE);
+            return;
+        }
+
+        blocks = (char *) malloc((long) have * recvcount * recvExtent);
+        if (blocks == NULL) {
+            printf("Rank %d: Could not allocate memory for a scatter.\n", rank);
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+        MPI_Recv(blocks, have * recvcount, recvtype, rank - span, 0, comm, MPI_STATUS_IGNORE);
+    }
+
+    // Forward the upper part of what this rank holds to each child, largest first.
+    for (mask = span >> 1; mask > 0; mask >>= 1) {
+        int child = rank + mask;
+        if (child >= p) continue;
+
+        int childSpan = (mask < p - child ? mask : p - child);
+        if (rank == 0)
+            MPI_Send((const char *) sendbuf + (MPI_Aint) child * sendcount * sendExtent, childSpan * sendcount,
+                     sendtype, child, 0, comm);
+        else
+            MPI_Send(blocks + (MPI_Aint) mask * recvcount * recvExtent, childSpan * recvcount, recvtype, child, 0, comm);
+    }
+
+    if (rank == 0) {
+        if (recvbuf != MPI_IN_PLACE)
+            MPI_Sendrecv(sendbuf, sendcount, sendtype, 0, 1, recvbuf, recvcount, recvtype, 0, 1, comm,
+                         MPI_STATUS_IGNORE);
+    } else {
+        memcpy(recvbuf, blocks, (long) recvcount * recvExtent);
+        free(blocks);
+    }
+}
+
+// As scatterBinomial(), but rank 0 sends every block itself.
+void scatterLinear(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                   void *recvbuf, int recvcount, MPI_Datatype recvtype, MPI_Comm comm) {
+    int rank, p, r;
+    MPI_Aint lowerBound, sendExtent;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &p);
+    MPI_Type_get_extent(sendtype, &lowerBound, &sendExtent);
+
+    if (rank != 0) {
+        MPI_Recv(recvbuf, recvcount, recvtype, 0, 0, comm, MPI_STATUS_IGNORE);
+        return;
+    }
+
+    MPI_Request *requests = (MPI_Request *) malloc(p * sizeof(MPI_Request));
+    if (requests == NULL) {
+        printf("Rank 0: Could not allocate memory for a scatter.\n");
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+
+    requests[0] = MPI_REQUEST_NULL;
+    for (r = 1; r < p; r++)
+        MPI_Isend((const char *) sendbuf + (MPI_Aint) r * sendcount * sendExtent, sendcount, sendtype, r, 0, comm,
+                  &requests[r]);
+    if (recvbuf != MPI_IN_PLACE)
+        MPI_Sendrecv(sendbuf, sendcount, sendtype, 0, 1, recvbuf, recvcount, recvtype, 0, 1, comm, MPI_STATUS_IGNORE);
+
+    MPI_Waitall(p, requests, MPI_STATUSES_IGNORE);
+    free(requests);
+}
+
+
+//
+// Collectives on MPI_COMM_WORLD, rooted at rank 0, with the algorithm given or COLL_AUTO.
+//
+
+void collBcast(void *buf, int count, MPI_Datatype type, const Collectives *coll, int algorithm) {
+    int size;
+    MPI_Type_size(type, &size);
+    if (algorithm == COLL_AUTO) algorithm = collChoose(coll, COLL_BCAST, (long) count * size);
+    if (algorithm == COLL_TWOLEVEL && coll->numNodes == 1) algorithm = COLL_BINOMIAL;
+
+    if (algorithm == COLL_BINOMIAL) {
+        bcastBinomial(buf, count, type, MPI_COMM_WORLD);
+    } else if (algorithm == COLL_CHAIN) {
+        bcastChain(buf, count, type, MPI_COMM_WORLD);
+    } else if (algorithm == COLL_TWOLEVEL) {
+        long bytes = (long) count * size;
+        if (coll->leaders != MPI_COMM_NULL) {
+            if (fasterTree(coll->numNodes, bytes, coll->alphaInter, coll->betaInter) == COLL_CHAIN)
+                bcastChain(buf, count, type, coll->leaders);
+            else
+                bcastBinomial(buf, count, type, coll->leaders);
+        }
+        if (fasterTree(coll->maxNodeSize, bytes, coll->alphaIntra, coll->betaIntra) == COLL_CHAIN)
+            bcastChain(buf, count, type, coll->node);
+        else
+            bcastBinomial(buf, count, type, coll->node);
+    } else {
+        MPI_Bcast(buf, count, type, 0, MPI_COMM_WORLD);
+    }
+}
+
+// Rank 0's recvbuf may be MPI_IN_PLACE, in which case its own block stays where it is in sendbuf.
+void collScatter(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                 void *recvbuf, int recvcount, MPI_Datatype recvtype, const Collectives *coll, int algorithm) {
+    int size, r;
+    MPI_Type_size(recvtype, &size);
+    if (algorithm == COLL_AUTO) algorithm = collChoose(coll, COLL_SCATTER, (long) recvcount * size);
+    if (algorithm == COLL_TWOLEVEL && (coll->numNodes == 1 || !coll->contiguous)) algorithm = COLL_BINOMIAL;
+
+    if (algorithm == COLL_BINOMIAL) {
+        scatterBinomial(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, MPI_COMM_WORLD);
+    } else if (algorithm == COLL_CHAIN) {
+        scatterLinear(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, MPI_COMM_WORLD);
+    } else if (algorithm == COLL_TWOLEVEL) {
+        // Rank 0 sends each other node's consecutive blocks to its leader, then every leader scatters
+        // within its node. Rank 0's node is scattered straight from sendbuf.
+        MPI_Aint lowerBound, sendExtent, recvExtent;
+        MPI_Type_get_extent(sendtype, &lowerBound, &sendExtent);
+        MPI_Type_get_extent(recvtype, &lowerBound, &recvExtent);
+
+        if (coll->rank == 0) {
+            for (r = 1; r < coll->numNodes; r++)
+                MPI_Send((const char *) sendbuf + (MPI_Aint) coll->nodeFirst[r] * sendcount * sendExtent,
+                         coll->nodeCount[r] * sendcount, sendtype, coll->nodeFirst[r], 0, MPI_COMM_WORLD);
+            MPI_Scatter(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, 0, coll->node);
+        } else if (coll->nodeRank == 0) {
+            char *received = (char *) malloc((long) coll->nodeSize * recvcount * recvExtent);
+            if (received == NULL) {
+                printf("Rank %d: Could not allocate memory for a scatter.\n", coll->rank);
+                MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+            }
+            MPI_Recv(received, coll->nodeSize * recvcount, recvtype, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            MPI_Scatter(received, recvcount, recvtype, recvbuf, recvcount, recvtype, 0, coll->node);
+            free(received);
+        } else {
+            MPI_Scatter(NULL, 0, recvtype, recvbuf, recvcount, recvtype, 0, coll->node);
+        }
+    } else {
+        MPI_Scatter(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, 0, MPI_COMM_WORLD);
+    }
+}
+
+// Rank 0's sendbuf may be MPI_IN_PLACE, taking its contribution from recvbuf.
+void collReduce(const void *sendbuf, void *recvbuf, int count, MPI_Datatype type, MPI_Op op,
+                const Collectives *coll, int algorithm) {
+    int size;
+    MPI_Type_size(type, &size);
+    if (algorithm == COLL_AUTO) algorithm = collChoose(coll, COLL_REDUCE, (long) count * size);
+    if (algorithm == COLL_TWOLEVEL && coll->numNodes == 1) algorithm = COLL_BINOMIAL;
+
+    if (algorithm == COLL_BINOMIAL) {
+        reduceBinomial(sendbuf, recvbuf, count, type, op, MPI_COMM_WORLD);
+    } else if (algorithm == COLL_CHAIN) {
+        reduceChain(sendbuf, recvbuf, count, type, op, MPI_COMM_WORLD);
+    } else if (algorithm == COLL_TWOLEVEL) {
+        // Reduce within each node to its leader, then between the leaders.
+        long bytes = (long) count * size;
+        char *partial = (char *) malloc(bytes > 0 ? bytes : 1);
+        if (partial == NULL) {
+            printf("Rank %d: Could not allocate memory for a reduction.\n", coll->rank);
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+
+        const void *mine = (coll->rank == 0 && sendbuf == MPI_IN_PLACE ? recvbuf : sendbuf);
+        if (fasterTree(coll->maxNodeSize, bytes, coll->alphaIntra, coll->betaIntra) == COLL_CHAIN)
+            reduceChain(mine, partial, count, type, op, coll->node);
+        else
+            reduceBinomial(mine, partial, count, type, op, coll->node);
+
+        if (coll->leaders != MPI_COMM_NULL) {
+            if (fasterTree(coll->numNodes, bytes, coll->alphaInter, coll->betaInter) == COLL_CHAIN)
+                reduceChain(partial, recvbuf, count, type, op, coll->leaders);
+            else
+                reduceBinomial(partial, recvbuf, count, type, op, coll->leaders);
+        }
+
+        free(partial);
+    } else {
+        MPI_Reduce(sendbuf, recvbuf, count, type, op, 0, MPI_COMM_WORLD);
+    }
+}
@@ -0,0 +1,550 @@
+//
+// Corpus mode for cwk2.c: the letters of many files counted together. Rank 0 keeps a work pool of pieces
+// of the files and hands them out one at a time, as in the WORK_POOL version of the Mandelbrot code, so a
+// rank that finishes early pulls more work rather than waiting on a rank with one big file. The other ranks
+// read their pieces themselves, and rank 0 can record each finished piece so a failed run can be resumed.
+// Needs mpi.h, cwk2_io.h, cwk2_count.h, cwk2_coll.h and cwk2_timers.h.
+//
+
+#include <dirent.h>
+#include <limits.h>
+
+
+// The default for the largest piece of a file handed out at once, so big files are shared between ranks.
+// Changed with -piece, e.g. for many pieces from a small test file.
+#define CORPUS_PIECE (16L << 20)
+
+// Tag for the work pool's messages, which must not match those of a collective started by a rank that has
+// already finished, as rank 0 receives from any source.
+#define CORPUS_TAG 1
+
+
+//
+// The list of files, with all their paths in one buffer so it can be broadcast in one go.
+//
+typedef struct {
+    int numFiles;
+    char *names;            // The paths, each terminated by '\0'.
+    long namesLength;       // Bytes used in names[].
+    long *nameOffsets;      // Start of each path within names[].
+    long *sizes;            // Size of each file in bytes; only known on rank 0.
+    long *mtimes;           // Modification time of each file in nanoseconds; only known on rank 0.
+    long totalSize;         // Sum of the sizes; only known on rank 0.
+    long pieceSize;         // Largest piece handed out at once; set on every rank.
+    int capacity;           // Files allocated for in nameOffsets[] and sizes[].
+    long namesCapacity;     // Bytes allocated for names[].
+} Corpus;
+
+
+void initCorpus(Corpus *corpus) {
+    corpus->numFiles = 0;
+    corpus->names = NULL;
+    corpus->namesLength = 0;
+    corpus->nameOffsets = NULL;
+    corpus->sizes = NULL;
+    corpus->mtimes = NULL;
+    corpus->totalSize = 0;
+    corpus->pieceSize = CORPUS_PIECE;
+    corpus->capacity = 0;
+    corpus->namesCapacity = 0;
+}
+
+void freeCorpus(Corpus *corpus) {
+    free(corpus->names);
+    free(corpus->nameOffsets);
+    free(corpus->sizes);
+    free(corpus->mtimes);
+    initCorpus(corpus);
+}
+
+const char *corpusFileName(const Corpus *corpus, int file) {
+    return corpus->names + corpus->nameOffsets[file];
+}
+
+// Appends one file, growing the arrays as needed. Returns 0 if okay, -1 if out of memory.
+int addCorpusFile(Corpus *corpus, const char *path, long size, long mtime) {
+    long length = (long) strlen(path) + 1;
+
+    if (corpus->numFiles == corpus->capacity) {
+        int capacity = (corpus->capacity > 0 ? 2 * corpus->capacity : 256);
+        long *nameOffsets = (long *) realloc(corpus->nameOffsets, capacity * sizeof(long));
+        if (nameOffsets == NULL) return -1;
+        corpus->nameOffsets = nameOffsets;
+        long *sizes = (long *) realloc(corpus->sizes, capacity * sizeof(long));
+        if (sizes == NULL) return -1;
+        corpus->sizes = sizes;
+        long *mtimes = (long *) realloc(corpus->mtimes, capacity * sizeof(long));
+        if (mtimes == NULL) return -1;
+        corpus->mtimes = mtimes;
+        corpus->capacity = capacity;
+    }
+
+    if (corpus->namesLength + length > corpus->namesCapacity) {
+        long namesCapacity = 2 * (corpus->namesLength + length);
+        char *names = (char *) realloc(corpus->names, namesCapacity * sizeof(char));
+        if (names == NULL) return -1;
+        corpus->names = names;
+        corpus->namesCapacity = namesCapacity;
+    }
+
+    memcpy(corpus->names + corpus->namesLength, path, length);
+    corpus->nameOffsets[corpus->numFiles] = corpus->namesLength;
+    corpus->sizes[corpus->numFiles] = size;
+    corpus->mtimes[corpus->numFiles] = mtime;
+    corpus->namesLength += length;
+    corpus->totalSize += size;
+    corpus->numFiles++;
+
+    return 0;
+}
+
+// Adds a path if it is a regular file, or everything below it if it is a directory. Empty files are skipped,
+// as they have nothing to count. Returns 0 if okay, -1 after printing an error message if not.
+int addCorpusPath(Corpus *corpus, const char *path) {
+    struct stat fileStatus;
+    if (stat(path, &fileStatus)) {
+        printf("Could not determine size of the file '%s'.\n", path);
+        return -1;
+    }
+
+    if (S_ISREG(fileStatus.st_mode)) {
+        long mtime = (long) fileStatus.st_mtim.tv_sec * 1000000000L + (long) fileStatus.st_mtim.tv_nsec;
+        if (fileStatus.st_size > 0 && addCorpusFile(corpus, path, (long) fileStatus.st_size, mtime) == -1) {
+            printf("Could not allocate memory for the list of files.\n");
+            return -1;
+        }
+        return 0;
+    }
+    if (!S_ISDIR(fileStatus.st_mode)) return 0;
+
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        printf("Could not open the directory '%s'.\n", path);
+        return -1;
+    }
+
+    struct dirent *entry;
+    int status = 0;
+    while (status == 0 && (entry = readdir(dir)) != NULL) {
+        if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) continue;
+
+        char *child = (char *) malloc(strlen(path) + strlen(entry->d_name) + 2);
+        if (child == NULL) {
+            printf("Could not allocate memory for the list of files.\n");
+            status = -1;
+            break;
+        }
+        sprintf(child, "%s/%s", path, entry->d_name);
+        status = addCorpusPath(corpus, child);
+        free(child);
+    }
+
+    closedir(dir);
+    return status;
+}
+
+// Lists the corpus on rank 0: every file below the path if it is a directory, else every path given one per
+// line in the file at the path, any of which may also be directories. Returns 0 if okay, -1 after printing an
+// error message if not.
+int listCorpus(const char *path, Corpus *corpus) {
+    initCorpus(corpus);
+
+    struct stat fileStatus;
+    if (stat(path, &fileStatus)) {
+        printf("Could not find the corpus '%s'.\n", path);
+        return -1;
+    }
+    if (S_ISDIR(fileStatus.st_mode)) return addCorpusPath(corpus, path);
+
+    FILE *list = fopen(path, "r");
+    if (list == NULL) {
+        printf("Could not open the file list '%s' for reading.\n", path);
+        return -1;
+    }
+
+    char line[PATH_MAX + 2];
+    int status = 0;
+    while (status == 0 && fgets(line, sizeof(line), list) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] != '\0') status = addCorpusPath(corpus, line);
+    }
+
+    fclose(list);
+    return status;
+}
+
+// Sends rank 0's list of paths to all ranks. The sizes stay on rank 0, which is the only rank that hands out
+// work. Must be called by all ranks.
+void broadcastCorpus(Corpus *corpus, int rank, const Collectives *coll, int algorithm) {
+    long header[2] = {corpus->numFiles, corpus->namesLength};
+    collBcast(header, 2, MPI_LONG, coll, algorithm);
+
+    if (header[1] > INT_MAX) {
+        if (rank == 0) printf("The list of files is too long to send (%ld bytes).\n", header[1]);
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+
+    if (rank != 0) {
+        corpus->numFiles = (int) header[0];
+        corpus->namesLength = header[1];
+        corpus->names = (char *) malloc((header[1] > 0 ? header[1] : 1) * sizeof(char));
+        corpus->nameOffsets = (long *) malloc((header[0] > 0 ? header[0] : 1) * sizeof(long));
+        if (corpus->names == NULL || corpus->nameOffsets == NULL) {
+            printf("Rank %d: Could not allocate memory for the list of files.\n", rank);
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+    }
+
+    collBcast(corpus->names, (int) corpus->namesLength, MPI_CHAR, coll, algorithm);
+
+    // Each path starts after the '\0' of the one before.
+    if (rank != 0) {
+        long offset = 0;
+        int file;
+        for (file = 0; file < corpus->numFiles; file++) {
+            corpus->nameOffsets[file] = offset;
+            offset += (long) strlen(corpus->names + offset) + 1;
+        }
+    }
+}
+
+
+//
+// The work pool. A piece is {file, offset, length}; a file of -1 means there is no more work.
+//
+
+// Sets the next piece after the given one, starting from the empty piece {0, 0, 0}. Returns 0 if there was
+// one, -1 (with piece[0] = -1, which stays so) if not. Rank 0 only.
+int nextCorpusPiece(const Corpus *corpus, long piece[3]) {
+    long file = piece[0], offset = piece[1] + piece[2];
+
+    if (file < 0) return -1;
+    if (file < corpus->numFiles && offset >= corpus->sizes[file]) {
+        file++;
+        offset = 0;
+    }
+    if (file >= corpus->numFiles) {
+        piece[0] = -1;
+        return -1;
+    }
+
+    piece[0] = file;
+    piece[1] = offset;
+    piece[2] = (corpus->sizes[file] - offset < corpus->pieceSize ? corpus->sizes[file] - offset : corpus->pieceSize);
+    return 0;
+}
+
+// Reads one piece into the buffer and adds its letters to hist[], adding the times to the read and count
+// phases. A file that has shrunk since it was listed is counted as far as it goes.
+void countCorpusPiece(const Corpus *corpus, const long piece[3], char *buffer, int numThreads, int *hist,
+                      PhaseTimers *timers) {
+    double lapStart = MPI_Wtime();
+    const char *fname = corpusFileName(corpus, (int) piece[0]);
+    long numRead = 0;
+
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0) {
+        printf("Could not open the file '%s' file for reading.\n", fname);
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+    while (numRead < piece[2]) {
+        ssize_t n = pread(fd, buffer + numRead, piece[2] - numRead, piece[1] + numRead);
+        if (n <= 0) break;
+        numRead += n;
+    }
+    close(fd);
+    lapStart = lapPhase(timers, PHASE_READ, numRead, lapStart);
+
+    countLettersParallel(buffer, numRead, numThreads, hist);
+    lapPhase(timers, PHASE_COUNT, numRead, lapStart);
+}
+
+
+//
+// Progress records, so a run that fails part way can be resumed. Rank 0 appends the counts of every finished
+// piece to a file as soon as it hears of it; a resumed run adds those counts in and only hands out the rest.
+//
+
+#define PROGRESS_VERSION 2
+
+typedef struct {
+    FILE *log;              // Where each finished piece's counts are appended.
+    long numPieces;         // Pieces in the whole corpus.
+    long numDone;           // Pieces counted by earlier runs.
+    char *done;             // One per piece: 1 if counted by an earlier run, else 0.
+} Progress;
+
+// Parses one complete record, "index file offset length" then the MAX_LETTERS counts. Returns 0 if okay, -1
+// if not, as for a line cut short when a run was killed.
+int parseProgressRecord(char *line, long record[4], int *counts) {
+    char *p = line, *end;
+    int i;
+
+    if (line[0] == '\0' || line[strlen(line) - 1] != '\n') return -1;
+    for (i = 0; i < 4 + MAX_LETTERS; i++, p = end) {
+        long value = strtol(p, &end, 10);
+        if (end == p || value < 0) return -1;
+        if (i < 4) record[i] = value;
+        else counts[i - 4] = (int) value;
+    }
+
+    return 0;
+}
+
+// Reads the header of an existing progress file, and checks it was written for the same pieces of the same
+// corpus: the same piece size, and the same files in the same order, each still with the size and modification
+// time it had then. Returns 1 if so, else 0 after printing why not.
+int progressMatches(FILE *old, const char *fname, const Corpus *corpus) {
+    int version = 0, numFiles = -1, file, pathStart;
+    long pieceSize = -1, size, mtime;
+    char line[PATH_MAX + 64];
+
+    if (fscanf(old, "cwk2 progress %d\n%d %ld\n", &version, &numFiles, &pieceSize) != 3 || version != PROGRESS_VERSION ||
+        numFiles != corpus->numFiles || pieceSize != corpus->pieceSize) {
+        printf("Progress file '%s' is not for this input; starting again.\n", fname);
+        return 0;
+    }
+
+    for (file = 0; file < numFiles; file++) {
+        pathStart = -1;
+        if (fgets(line, sizeof(line), old) == NULL || sscanf(line, "%ld %ld%n", &size, &mtime, &pathStart) != 2 ||
+            pathStart < 0 || line[pathStart] != ' ') {
+            printf("Progress file '%s' could not be read; starting again.\n", fname);
+            return 0;
+        }
+        line[strcspn(line, "\n")] = '\0';
+        if (strcmp(line + pathStart + 1, corpusFileName(corpus, file))) {
+            printf("Progress file '%s' is not for this input; starting again.\n", fname);
+            return 0;
+        }
+        if (size != corpus->sizes[file] || mtime != corpus->mtimes[file]) {
+            printf("'%s' has changed since progress file '%s' was started; starting again.\n",
+                   corpusFileName(corpus, file), fname);
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Opens the progress file on rank 0. When resuming, the counts of the pieces it records are added to hist[]
+// and those pieces marked done, and new records are appended; otherwise, or if the file does not match the
+// corpus, it is started afresh. Returns 0 if okay, -1 after printing an error message if not.
+int openProgress(const char *fname, int resume, const Corpus *corpus, Progress *progress, int *hist) {
+    long piece[3] = {0, 0, 0}, index, record[4];
+    int counts[MAX_LETTERS], i;
+
+    progress->numPieces = 0;
+    progress->numDone = 0;
+    while (nextCorpusPiece(corpus, piece) == 0) progress->numPieces++;
+
+    long *pieces = (long *) malloc(3 * (progress->numPieces > 0 ? progress->numPieces : 1) * sizeof(long));
+    progress->done = (char *) calloc(progress->numPieces > 0 ? progress->numPieces : 1, sizeof(char));
+    if (pieces == NULL || progress->done == NULL) {
+        printf("Could not allocate memory for the progress of %ld pieces.\n", progress->numPieces);
+        free(pieces);
+        return -1;
+    }
+    piece[0] = piece[1] = piece[2] = 0;
+    for (index = 0; nextCorpusPiece(corpus, piece) == 0; index++) memcpy(pieces + 3 * index, piece, 3 * sizeof(long));
+
+    // Only pieces that are still the same part of the same, unchanged corpus are taken as done.
+    FILE *old = (resume ? fopen(fname, "r") : NULL);
+    int matches = 0, endsLine = 1;
+    if (old != NULL) {
+        matches = progressMatches(old, fname, corpus);
+
+        char line[32 * (4 + MAX_LETTERS)];
+        while (matches && fgets(line, sizeof(line), old) != NULL) {
+            endsLine = (line[strlen(line) - 1] == '\n');
+            if (parseProgressRecord(line, record, counts) == -1) continue;
+            index = record[0];
+            if (index >= progress->numPieces || progress->done[index] || record[1] != pieces[3 * index] ||
+                record[2] != pieces[3 * index + 1] || record[3] != pieces[3 * index + 2])
+                continue;
+
+            progress->done[index] = 1;
+            progress->numDone++;
+            for (i = 0; i < MAX_LETTERS; i++) hist[i] += counts[i];
+        }
+        fclose(old);
+    }
+    free(pieces);
+
+    progress->log = fopen(fname, matches ? "a" : "w");
+    if (progress->log == NULL) {
+        printf("Could not open the progress file '%s' for output.\n", fname);
+        free(progress->done);
+        return -1;
+    }
+    // New records start on a line of their own, after any record cut short.
+    if (matches && !endsLine) fprintf(progress->log, "\n");
+    if (!matches) {
+        fprintf(progress->log, "cwk2 progress %d\n%d %ld\n", PROGRESS_VERSION, corpus->numFiles, corpus->pieceSize);
+        for (i = 0; i < corpus->numFiles; i++)
+            fprintf(progress->log, "%ld %ld %s\n", corpus->sizes[i], corpus->mtimes[i], corpusFileName(corpus, i));
+        fflush(progress->log);
+    }
+
+    return 0;
+}
+
+// Appends the counts of a finished piece. Flushed at once, so the record survives this or any other rank
+// being killed.
+void recordProgress(Progress *progress, long index, const long piece[3], const int *counts) {
+    int i;
+
+    fprintf(progress->log, "%ld %ld %ld %ld", index, piece[0], piece[1], piece[2]);
+    for (i = 0; i < MAX_LETTERS; i++) fprintf(progress->log, " %d", counts[i]);
+    fprintf(progress->log, "\n");
+    fflush(progress->log);
+}
+
+void closeProgress(Progress *progress) {
+    fclose(progress->log);
+    free(progress->done);
+}
+
+// As nextCorpusPiece(), but skipping pieces done by earlier runs if progress is not NULL, and keeping count
+// of the index of the piece, which starts at -1.
+int nextPendingPiece(const Corpus *corpus, const Progress *progress, long piece[3], long *index) {
+    int status;
+
+    do {
+        status = nextCorpusPiece(corpus, piece);
+        if (status == 0) (*index)++;
+    } while (status == 0 && progress != NULL && progress->done[*index]);
+
+    return status;
+}
+
+
+//
+// Counting from the work pool.
+//
+
+// Rank 0 with other ranks: sends each of them a first piece, then another each time one reports back with
+// the counts of its last, until there are none left, when it tells that rank to stop. The counts are only
+// recorded, as they are also in the ranks' own histograms. Returns the number of pieces handed out.
+long corpusMaster(const Corpus *corpus, int numProcs, Progress *progress) {
+    long piece[3] = {0, 0, 0}, index = -1, numPieces = 0;
+    int p, numActive = 0, counts[MAX_LETTERS];
+    MPI_Status status;
+
+    // The piece each rank is working on.
+    long *held = (long *) malloc(4 * numProcs * sizeof(long));
+    if (held == NULL) {
+        printf("Rank 0: Could not allocate memory for the work pool.\n");
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+
+    for (p = 1; p < numProcs; p++) {
+        if (nextPendingPiece(corpus, progress, piece, &index) == 0) {
+            numActive++;
+            numPieces++;
+        }
+        memcpy(held + 4 * p, piece, 3 * sizeof(long));
+        held[4 * p + 3] = index;
+        MPI_Send(piece, 3, MPI_LONG, p, CORPUS_TAG, MPI_COMM_WORLD);
+    }
+
+    while (numActive > 0) {
+        MPI_Recv(counts, MAX_LETTERS, MPI_INT, MPI_ANY_SOURCE, CORPUS_TAG, MPI_COMM_WORLD, &status);
+        numActive--;
+
+        p = status.MPI_SOURCE;
+        if (progress != NULL) recordProgress(progress, held[4 * p + 3], held + 4 * p, counts);
+
+        if (nextPendingPiece(corpus, progress, piece, &index) == 0) {
+            numActive++;
+            numPieces++;
+        }
+        memcpy(held + 4 * p, piece, 3 * sizeof(long));
+        held[4 * p + 3] = index;
+        MPI_Send(piece, 3, MPI_LONG, p, CORPUS_TAG, MPI_COMM_WORLD);
+    }
+
+    free(held);
+    return numPieces;
+}
+
+// The other ranks: counts pieces until told to stop, reporting the counts of each back. Time spent waiting for
+// work is added to the scatter phase.
+void corpusWorker(const Corpus *corpus, int rank, int numThreads, int *hist, PhaseTimers *timers) {
+    char *buffer = (char *) malloc(corpus->pieceSize * sizeof(char));
+    if (buffer == NULL) {
+        printf("Rank %d: Could not allocate memory for the corpus buffer.\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+
+    long piece[3];
+    int counts[MAX_LETTERS], i;
+    double lapStart = MPI_Wtime();
+    MPI_Recv(piece, 3, MPI_LONG, 0, CORPUS_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+    while (piece[0] >= 0) {
+        lapPhase(timers, PHASE_SCATTER, piece[2], lapStart);
+        for (i = 0; i < MAX_LETTERS; i++) counts[i] = 0;
+        countCorpusPiece(corpus, piece, buffer, numThreads, counts, timers);
+        for (i = 0; i < MAX_LETTERS; i++) hist[i] += counts[i];
+
+        lapStart = MPI_Wtime();
+        MPI_Send(counts, MAX_LETTERS, MPI_INT, 0, CORPUS_TAG, MPI_COMM_WORLD);
+        MPI_Recv(piece, 3, MPI_LONG, 0, CORPUS_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    }
+    lapPhase(timers, PHASE_SCATTER, 0, lapStart);
+
+    free(buffer);
+}
+
+// Counts the letters of the whole corpus, less any pieces progress says are done, into hist[] on the ranks
+// other than 0, or on rank 0 if it is the only one. Progress is only used on rank 0, and may be NULL. Returns
+// the number of pieces counted on rank 0. Must be called by all ranks.
+long countCorpus(const Corpus *corpus, int rank, int numProcs, int numThreads, int *hist, Progress *progress,
+                 PhaseTimers *timers) {
+    if (numProcs > 1) {
+        if (rank != 0) {
+            corpusWorker(corpus, rank, numThreads, hist, timers);
+            return 0;
+        }
+        double lapStart = MPI_Wtime();
+        long numPieces = corpusMaster(corpus, numProcs, progress);
+        lapPhase(timers, PHASE_SCATTER, 0, lapStart);
+        return numPieces;
+    }
+
+    char *buffer = (char *) malloc(corpus->pieceSize * sizeof(char));
+    if (buffer == NULL) {
+        printf("Rank %d: Could not allocate memory for the corpus buffer.\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+
+    long piece[3] = {0, 0, 0}, index = -1, numPieces = 0;
+    int counts[MAX_LETTERS], i;
+    while (nextPendingPiece(corpus, progress, piece, &index) == 0) {
+        for (i = 0; i < MAX_LETTERS; i++) counts[i] = 0;
+        countCorpusPiece(corpus, piece, buffer, numThreads, counts, timers);
+        for (i = 0; i < MAX_LETTERS; i++) hist[i] += counts[i];
+        if (progress != NULL) recordProgress(progress, index, piece, counts);
+        numPieces++;
+    }
+
+    free(buffer);
+    return numPieces;
+}
+
+// Counts the whole corpus one file at a time on this rank alone, for checking. Files that cannot be mapped are
+// reported and skipped.
+void countCorpusSerial(const Corpus *corpus, int *hist) {
+    MappedText mapped;
+    long j;
+    int file, lc;
+
+    for (file = 0; file < corpus->numFiles; file++) {
+        if (mapText(corpusFileName(corpus, file), 1, &mapped) == -1) continue;
+        for (j = 0; j < mapped.size; j++)
+            if ((lc = letterCodeForChar(mapped.text[j])) != -1)
+                hist[lc]++;
+        unmapText(&mapped);
+    }
+}
@@ -0,0 +1,218 @@
+//
+// Fast letter counting kernels for cwk2.c, giving the same counts as calling letterCodeForChar() on every
+// character. Needs MAX_LETTERS, and letterCodeForChar() from cwk2_extra.h.
+//
+// The scalar kernel looks each byte up in a 256-entry table and spreads consecutive bytes over four
+// sub-histograms, so runs of the same letter do not stall on incrementing one counter. On x86 CPUs with
+// AVX2, 32 bytes at a time are classified into letter codes with one OR and one subtract, and counted with
+// shuffle lookups into 4-bit counters, two letters per byte lane; with AVX-512BW, 64 bytes at a time.
+//
+// countLettersParallel() splits the text between OpenMP threads, each with its own private histogram, so
+// one rank can use every core of a socket or node.
+//
+
+#include <stdint.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#define COUNT_X86
+#include <immintrin.h>
+#endif
+
+
+// Letter code for every byte value, with MAX_LETTERS (a spare bucket that is then ignored) for anything
+// that is not a letter, so the inner loop has no branches.
+unsigned char letterTable[256];
+int letterTableReady = 0;
+
+// Fills letterTable[] from letterCodeForChar(), so both always agree.
+void initLetterTable() {
+    int c;
+
+    for (c = 0; c < 256; c++) {
+        int code = letterCodeForChar((char) c);
+        letterTable[c] = (unsigned char) (code == -1 ? MAX_LETTERS : code);
+    }
+    letterTableReady = 1;
+}
+
+// Adds the letter counts for text[0..n-1] to hist[], using the table.
+void countLettersTable(const char *text, long n, int *hist) {
+    const unsigned char *bytes = (const unsigned char *) text;
+    long sub[4][MAX_LETTERS + 1];
+    long i;
+    int lc;
+
+    if (!letterTableReady) initLetterTable();
+    memset(sub, 0, sizeof(sub));
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        sub[0][letterTable[bytes[i]]]++;
+        sub[1][letterTable[bytes[i + 1]]]++;
+        sub[2][letterTable[bytes[i + 2]]]++;
+        sub[3][letterTable[bytes[i + 3]]]++;
+    }
+    for (; i < n; i++) sub[0][letterTable[bytes[i]]]++;
+
+    for (lc = 0; lc < MAX_LETTERS; lc++) hist[lc] += sub[0][lc] + sub[1][lc] + sub[2][lc] + sub[3][lc];
+}
+
+#ifdef COUNT_X86
+
+// Vectors counted into the 4-bit counters of countLettersAVX2() before they are added up, so they cannot overflow.
+#define NIBBLE_VECTORS 15
+
+// Adds the letter counts for text[0..n-1] to hist[], 32 bytes at a time.
+//
+// Folding each byte to lower case and subtracting 'a' gives letters the codes 0 to 25, and every other byte
+// something outside that range. Each letter is then counted in a 4-bit counter, two letters to a byte lane: a
+// shuffle indexed by the code looks up 0x01 for the pair's first letter, 0x10 for its second and 0 for anything
+// else, and is added to the pair's accumulator, so the 26 letters take 13 shuffles and 13 adds per 32 bytes
+// rather than a compare and add each. A shuffle table only covers 16 codes, so pairs 0 to 7 are indexed by the
+// codes and pairs 8 to 12 by the codes less 16, with the same tables as pairs 0 to 4; a saturating add of 0x70
+// sets the top bit of any index out of range, for which the shuffle gives 0.
+//
+// The bytes are classified once per block of NIBBLE_VECTORS vectors, which then stays in the L1 cache while each
+// pair is counted over it in turn. Counting all 13 pairs at once would need more than the 16 AVX2 registers, and
+// spilling the accumulators costs a load and a store per pair per vector.
+__attribute__((target("avx2")))
+void countLettersAVX2(const char *text, long n, int *hist) {
+    const __m256i zero = _mm256_setzero_si256(), caseBit = _mm256_set1_epi8(0x20);
+    const __m256i letterA = _mm256_set1_epi8('a'), sixteen = _mm256_set1_epi8(16);
+    const __m256i toIndex = _mm256_set1_epi8(0x70), lowNibbles = _mm256_set1_epi8(0x0F);
+    __m256i tables[8], sums[MAX_LETTERS], low[NIBBLE_VECTORS], high[NIBBLE_VECTORS];
+    long i = 0;
+    int pair, lc, v;
+
+    // The same 16 entries in both 128-bit lanes, as the shuffle works within each.
+    for (pair = 0; pair < 8; pair++) {
+        unsigned char table[32];
+
+        memset(table, 0, sizeof(table));
+        table[2 * pair] = table[2 * pair + 16] = 0x01;
+        table[2 * pair + 1] = table[2 * pair + 17] = 0x10;
+        tables[pair] = _mm256_loadu_si256((const __m256i *) table);
+    }
+    for (lc = 0; lc < MAX_LETTERS; lc++) sums[lc] = zero;
+
+    while (n - i >= 32 * NIBBLE_VECTORS) {
+        for (v = 0; v < NIBBLE_VECTORS; v++, i += 32) {
+            __m256i c = _mm256_loadu_si256((const __m256i *) (text + i));
+            __m256i code = _mm256_sub_epi8(_mm256_or_si256(c, caseBit), letterA);
+            low[v] = _mm256_adds_epu8(code, toIndex);
+            high[v] = _mm256_adds_epu8(_mm256_sub_epi8(code, sixteen), toIndex);
+        }
+
+        for (pair = 0; pair < MAX_LETTERS / 2; pair++) {
+            const __m256i *index = (pair < 8 ? low : high), table = tables[pair < 8 ? pair : pair - 8];
+            __m256i acc = zero;
+
+#pragma GCC unroll 15
+            for (v = 0; v < NIBBLE_VECTORS; v++) acc = _mm256_add_epi8(acc, _mm256_shuffle_epi8(table, index[v]));
+
+            // Split the pair's counters and sum their 32 byte lanes into four 64-bit lanes.
+            __m256i first = _mm256_and_si256(acc, lowNibbles);
+            __m256i second = _mm256_and_si256(_mm256_srli_epi16(acc, 4), lowNibbles);
+            sums[2 * pair] = _mm256_add_epi64(sums[2 * pair], _mm256_sad_epu8(first, zero));
+            sums[2 * pair + 1] = _mm256_add_epi64(sums[2 * pair + 1], _mm256_sad_epu8(second, zero));
+        }
+    }
+
+    for (lc = 0; lc < MAX_LETTERS; lc++)
+        hist[lc] += _mm256_extract_epi64(sums[lc], 0) + _mm256_extract_epi64(sums[lc], 1)
+                  + _mm256_extract_epi64(sums[lc], 2) + _mm256_extract_epi64(sums[lc], 3);
+
+    countLettersTable(text + i, n - i, hist);
+}
+
+// As countLettersAVX2(), but 64 bytes at a time. With 32 registers the 13 accumulators and the 8 tables all fit,
+// so each vector is classified and counted in a single pass.
+__attribute__((target("avx512bw")))
+void countLettersAVX512(const char *text, long n, int *hist) {
+    const __m512i zero = _mm512_setzero_si512(), caseBit = _mm512_set1_epi8(0x20);
+    const __m512i letterA = _mm512_set1_epi8('a'), sixteen = _mm512_set1_epi8(16);
+    const __m512i toIndex = _mm512_set1_epi8(0x70), lowNibbles = _mm512_set1_epi8(0x0F);
+    __m512i tables[8], acc[MAX_LETTERS / 2], sums[MAX_LETTERS];
+    long i = 0;
+    int pair, lc, v;
+
+    // The same 16 entries in all four 128-bit lanes, as the shuffle works within each.
+    for (pair = 0; pair < 8; pair++) {
+        unsigned char table[16];
+
+        memset(table, 0, sizeof(table));
+        table[2 * pair] = 0x01;
+        table[2 * pair + 1] = 0x10;
+        tables[pair] = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *) table));
+    }
+    for (lc = 0; lc < MAX_LETTERS; lc++) sums[lc] = zero;
+
+    while (n - i >= 64 * NIBBLE_VECTORS) {
+        for (pair = 0; pair < MAX_LETTERS / 2; pair++) acc[pair] = zero;
+
+        for (v = 0; v < NIBBLE_VECTORS; v++, i += 64) {
+            __m512i c = _mm512_loadu_si512((const void *) (text + i));
+            __m512i code = _mm512_sub_epi8(_mm512_or_si512(c, caseBit), letterA);
+            __m512i low = _mm512_adds_epu8(code, toIndex);
+            __m512i high = _mm512_adds_epu8(_mm512_sub_epi8(code, sixteen), toIndex);
+
+            // Unrolled so the accumulators stay in registers.
+#pragma GCC unroll 8
+            for (pair = 0; pair < 8; pair++)
+                acc[pair] = _mm512_add_epi8(acc[pair], _mm512_shuffle_epi8(tables[pair], low));
+#pragma GCC unroll 8
+            for (pair = 8; pair < MAX_LETTERS / 2; pair++)
+                acc[pair] = _mm512_add_epi8(acc[pair], _mm512_shuffle_epi8(tables[pair - 8], high));
+        }
+
+        for (pair = 0; pair < MAX_LETTERS / 2; pair++) {
+            __m512i first = _mm512_and_si512(acc[pair], lowNibbles);
+            __m512i second = _mm512_and_si512(_mm512_srli_epi16(acc[pair], 4), lowNibbles);
+            sums[2 * pair] = _mm512_add_epi64(sums[2 * pair], _mm512_sad_epu8(first, zero));
+            sums[2 * pair + 1] = _mm512_add_epi64(sums[2 * pair + 1], _mm512_sad_epu8(second, zero));
+        }
+    }
+
+    for (lc = 0; lc < MAX_LETTERS; lc++) hist[lc] += _mm512_reduce_add_epi64(sums[lc]);
+
+    countLettersAVX2(text + i, n - i, hist);
+}
+
+#endif
+
+// Adds the letter counts for text[0..n-1] to hist[], using the fastest kernel this CPU supports.
+void countLetters(const char *text, long n, int *hist) {
+#ifdef COUNT_X86
+    if (__builtin_cpu_supports("avx512bw")) {
+        countLettersAVX512(text, n, hist);
+        return;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        countLettersAVX2(text, n, hist);
+        return;
+    }
+#endif
+    countLettersTable(text, n, hist);
+}
+
+// Adds the letter counts for text[0..n-1] to hist[] using numThreads OpenMP threads, or one thread if not
+// compiled with OpenMP. Each thread counts a contiguous slice, starting on a 64-byte boundary so no two
+// threads share a cache line, into a private copy of the histogram; the copies are summed by the reduction.
+void countLettersParallel(const char *text, long n, int numThreads, int *hist) {
+    // Fill the table before the threads start, so they only ever read it.
+    if (!letterTableReady) initLetterTable();
+
+#ifdef _OPENMP
+#pragma omp parallel num_threads(numThreads) reduction(+:hist[:MAX_LETTERS])
+    {
+        long slice = 64 * ((n + 64L * omp_get_num_threads() - 1) / (64L * omp_get_num_threads()));
+        long start = slice * omp_get_thread_num();
+
+        if (start < n) countLetters(text + start, (n - start < slice ? n - start : slice), hist);
+    }
+#else
+    countLetters(text, n, hist);
+#endif
+}
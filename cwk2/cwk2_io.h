@@ -0,0 +1,140 @@
+//
+// Alternative input routines for cwk2.c. Unlike readText() in cwk2_extra.h, sizes are 64-bit and the
+// file is never copied into a separate buffer.
+//
+
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+//
+// A read-only memory mapping of a text file, padded to a multiple of a given length. The padding is
+// virtual: the region beyond the end of the file is backed by anonymous pages, which read as zero (not a
+// letter) and are never written, so no padding pass or copy is needed.
+//
+typedef struct {
+    char *text;             // Start of the file contents; page aligned.
+    long size;              // Size of the file in bytes.
+    long paddedSize;        // Size rounded up to the padding multiple.
+    long mappedLength;      // Length of the whole mapping, rounded up to a page.
+} MappedText;
+
+
+// Rounds up to the next multiple.
+long roundUp(long value, long multiple) {
+    return multiple * ((value + multiple - 1) / multiple);
+}
+
+// Maps the file read-only, with paddedSize a multiple of paddingMultiple. Returns 0 if okay, -1 after
+// printing an error message if not. Pages are only loaded as they are first touched, and the kernel is
+// told access will be sequential so it can read ahead aggressively.
+int mapText(const char *fname, long paddingMultiple, MappedText *m) {
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0) {
+        printf("Could not open the file '%s' file for reading.\n", fname);
+        return -1;
+    }
+
+    struct stat fileStatus;
+    if (fstat(fd, &fileStatus) || fileStatus.st_size <= 0) {
+        printf("File '%s' has bad size (zero or negative).\n", fname);
+        close(fd);
+        return -1;
+    }
+
+    long pageSize = sysconf(_SC_PAGESIZE);
+    m->size = (long) fileStatus.st_size;
+    m->paddedSize = roundUp(m->size, paddingMultiple);
+    m->mappedLength = roundUp(m->paddedSize, pageSize);
+
+    // Reserve the whole padded range as zero pages, then map the file over the start of it.
+    m->text = (char *) mmap(NULL, m->mappedLength, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (m->text == MAP_FAILED ||
+        mmap(m->text, m->size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        printf("Could not map the file '%s' into memory.\n", fname);
+        if (m->text != MAP_FAILED) munmap(m->text, m->mappedLength);
+        close(fd);
+        return -1;
+    }
+
+    // The mapping keeps its own reference to the file.
+    close(fd);
+
+    madvise(m->text, m->size, MADV_SEQUENTIAL);
+
+    return 0;
+}
+
+// Returns a pointer to bytes [offset, offset+length) of the mapping, asking the kernel to start reading
+// them in. madvise() needs a page-aligned range, so the advice covers every page the view touches.
+const char *mapView(const MappedText *m, long offset, long length) {
+    long start = offset - offset % sysconf(_SC_PAGESIZE), end = (offset + length < m->size ? offset + length : m->size);
+    if (start < end) madvise(m->text + start, end - start, MADV_WILLNEED);
+    return m->text + offset;
+}
+
+// Releases the mapping.
+void unmapText(MappedText *m) {
+    munmap(m->text, m->mappedLength);
+    m->text = NULL;
+}
+
+
+//
+// Parallel reading with MPI-IO, so every rank loads its own block of the file and rank 0 never holds more
+// than its share. Needs mpi.h to have been included first.
+//
+
+// The largest number of bytes read by one MPI_File_read_at_all() call, so int counts cannot overflow.
+#define MPIIO_ROUND (1L << 30)
+
+// Collectively reads the file, giving each rank a block of ceil(size/numProcs) bytes in a newly allocated
+// buffer. Past the end of the file the block is filled with zeros, which are not letters. Sets the block
+// size and the total padded size, and returns NULL (with a message from rank 0) if the file could not be
+// read. Must be called by all ranks.
+char *readTextMPIIO(const char *fname, int rank, int numProcs, long *charsPerProc, long *totalChars) {
+    MPI_File file;
+    if (MPI_File_open(MPI_COMM_WORLD, (char *) fname, MPI_MODE_RDONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+        if (rank == 0) printf("Could not open the file '%s' file for reading.\n", fname);
+        return NULL;
+    }
+
+    MPI_Offset fileSize;
+    MPI_File_get_size(file, &fileSize);
+    if (fileSize <= 0) {
+        if (rank == 0) printf("File '%s' has bad size (zero or negative).\n", fname);
+        MPI_File_close(&file);
+        return NULL;
+    }
+
+    *charsPerProc = ((long) fileSize + numProcs - 1) / numProcs;
+    *totalChars = *charsPerProc * numProcs;
+
+    char *text = (char *) malloc(*charsPerProc * sizeof(char));
+    if (text == NULL) {
+        printf("Rank %d: Could not allocate memory for the character array.\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+
+    // Every rank makes the same number of collective calls, as the blocks are all the same size.
+    long offset;
+    MPI_Offset start = (MPI_Offset) rank * *charsPerProc;
+    for (offset = 0; offset < *charsPerProc; offset += MPIIO_ROUND) {
+        int len = (int) (*charsPerProc - offset < MPIIO_ROUND ? *charsPerProc - offset : MPIIO_ROUND);
+
+        MPI_Status status;
+        int numRead = 0;
+        MPI_File_read_at_all(file, start + offset, text + offset, len, MPI_CHAR, &status);
+        MPI_Get_count(&status, MPI_CHAR, &numRead);
+        if (numRead == MPI_UNDEFINED) numRead = 0;
+
+        if (numRead < len) memset(text + offset + numRead, 0, len - numRead);
+    }
+
+    MPI_File_close(&file);
+
+    return text;
+}
@@ -0,0 +1,207 @@
+//
+// Sums histogram shards written by cwk2 -shard, from any number of ranks or jobs, into one shard. Dense shards
+// are added into one array of every bucket; sparse shards are merged together in a single pass, a block of
+// each at a time, straight into the output.
+//
+// Compile with:
+//
+// mpicc -Wall -O2 -fopenmp -std=c99 -o cwk2_merge cwk2_merge.c
+//
+// or use 'make merge'. Does not use MPI; the OpenMP flag only enables the vectorised adds.
+//
+
+#include "cwk2_shard.h"
+
+
+// Adds the dense shard in file to sum[], checking its total. Returns 0 if okay, -1 if not.
+int addDenseShard(FILE *file, const ShardHeader *header, uint64_t *sum, uint64_t *block, const char *fname) {
+    uint64_t done, total = 0;
+    long i;
+
+    for (done = 0; done < header->numRecords; done += SHARD_BLOCK) {
+        long n = (long) (header->numRecords - done < SHARD_BLOCK ? header->numRecords - done : SHARD_BLOCK);
+        if (fread(block, sizeof(uint64_t), n, file) != (size_t) n) {
+            printf("Shard '%s' is shorter than its header says.\n", fname);
+            return -1;
+        }
+        for (i = 0; i < n; i++) total += block[i];
+        addShardCounts(sum + done, block, n);
+    }
+
+    if (total != header->total) {
+        printf("Shard '%s' does not add up to its total.\n", fname);
+        return -1;
+    }
+    return 0;
+}
+
+// Restores the order of the heap of shards, heap[0..n-1] holding indices into readers[] with the smallest
+// current key first, below position i.
+void siftShardHeap(int *heap, int n, const ShardReader *readers, int i) {
+    while (1) {
+        int smallest = i, child;
+        for (child = 2 * i + 1; child <= 2 * i + 2 && child < n; child++)
+            if (readers[heap[child]].current.key < readers[heap[smallest]].current.key) smallest = child;
+        if (smallest == i) return;
+
+        int swap = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = swap;
+        i = smallest;
+    }
+}
+
+// Merges the sparse shards names[0..numShards-1], which must count the same buckets as first, into out, begun by
+// startShard(). A k-way merge: the shards are kept in a heap by the key each is up to, so every record is read
+// once, and only a block of each shard is in memory. Each merged record is written (and printed if printText)
+// as soon as it is complete, and counted in header's number of records and total. Returns 0 if okay, -1 after
+// printing an error message if not.
+int mergeSparseShards(char **names, int numShards, const ShardHeader *first, FILE *out, const char *outName,
+                      ShardHeader *header, int printText) {
+    ShardReader *readers = (ShardReader *) malloc(numShards * sizeof(ShardReader));
+    int *heap = (int *) malloc(numShards * sizeof(int));
+    ShardRecord *block = (ShardRecord *) malloc(SHARD_READ_BLOCK * sizeof(ShardRecord));
+    int numOpen = 0, heapSize = 0, status = 0, s;
+    long numInBlock = 0;
+
+    if (readers == NULL || heap == NULL || block == NULL) {
+        printf("Could not allocate memory for merging %d shards.\n", numShards);
+        status = -1;
+    }
+
+    // All the shards are open at once, so their number is limited by the number of files a process may open.
+    for (s = 0; status == 0 && s < numShards; s++) {
+        int opened = openShardReader(&readers[s], names[s]);
+        numOpen = s + 1;
+
+        if (opened == -1) {
+            status = -1;
+        } else if (!shardsCompatible(first, &readers[s].header)) {
+            printf("Shard '%s' does not count the same buckets as '%s'.\n", names[s], names[0]);
+            status = -1;
+        } else if (opened == 1) {
+            heap[heapSize++] = s;
+        }
+    }
+    for (s = heapSize / 2 - 1; status == 0 && s >= 0; s--) siftShardHeap(heap, heapSize, readers, s);
+
+    header->numRecords = 0;
+    header->total = 0;
+    while (status == 0 && heapSize > 0) {
+        ShardRecord merged = {readers[heap[0]].current.key, 0};
+
+        // Every shard with this key is at the top of the heap in turn.
+        while (status == 0 && heapSize > 0 && readers[heap[0]].current.key == merged.key) {
+            ShardReader *reader = &readers[heap[0]];
+            merged.count += reader->current.count;
+
+            int next = advanceShardReader(reader);
+            if (next == -1) {
+                status = -1;
+            } else if (next == 0) {
+                closeShardReader(reader);
+                heap[0] = heap[--heapSize];
+            }
+            siftShardHeap(heap, heapSize, readers, 0);
+        }
+
+        header->numRecords++;
+        header->total += merged.count;
+        if (printText) printf("%lu %lu\n", (unsigned long) merged.key, (unsigned long) merged.count);
+
+        block[numInBlock++] = merged;
+        if (status == 0 && (numInBlock == SHARD_READ_BLOCK || heapSize == 0)) {
+            if (fwrite(block, sizeof(ShardRecord), numInBlock, out) != (size_t) numInBlock) {
+                printf("Could not write the shard '%s'.\n", outName);
+                status = -1;
+            }
+            numInBlock = 0;
+        }
+    }
+
+    for (s = 0; s < numOpen; s++) closeShardReader(&readers[s]);
+    free(readers);
+    free(heap);
+    free(block);
+    return status;
+}
+
+
+//
+// Main
+//
+int main(int argc, char **argv) {
+    char *outName = "merged.shard";
+    int printText = 0, first, s;
+
+    for (first = 1; first < argc && argv[first][0] == '-'; first++) {
+        if (!strcmp(argv[first], "-o") && first + 1 < argc) outName = argv[++first];
+        else if (!strcmp(argv[first], "-text")) printText = 1;
+        else break;
+    }
+    if (first == argc || argv[first][0] == '-') {
+        printf("Usage: %s [-o OUT] [-text] SHARD...; sums the shards into OUT (default merged.shard), and with -text"
+               " also prints each non-zero bucket as \"key count\".\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // The first shard decides the kind and layout, which all the others must match.
+    ShardHeader header, next;
+    FILE *file = openShard(argv[first], &header);
+    if (file == NULL) return EXIT_FAILURE;
+    fclose(file);
+
+    int status = 0;
+    if (header.layout == SHARD_DENSE) {
+        // Dense shards are added one at a time into a single array of every bucket.
+        uint64_t *dense = (uint64_t *) calloc(header.numBuckets > 0 ? header.numBuckets : 1, sizeof(uint64_t));
+        uint64_t *block = (uint64_t *) malloc(SHARD_BLOCK * sizeof(uint64_t));
+        if (dense == NULL || block == NULL) {
+            printf("Could not allocate memory for %lu buckets.\n", (unsigned long) header.numBuckets);
+            return EXIT_FAILURE;
+        }
+
+        for (s = first; status == 0 && s < argc; s++) {
+            if ((file = openShard(argv[s], &next)) == NULL) {
+                status = -1;
+                break;
+            }
+
+            if (!shardsCompatible(&header, &next) || next.numRecords != next.numBuckets) {
+                printf("Shard '%s' does not count the same buckets as '%s'.\n", argv[s], argv[first]);
+                status = -1;
+            } else {
+                status = addDenseShard(file, &next, dense, block, argv[s]);
+            }
+            fclose(file);
+        }
+
+        if (status == 0) {
+            header.numRecords = header.numBuckets;
+            status = writeShard(outName, &header, dense);
+        }
+
+        uint64_t i;
+        for (i = 0; status == 0 && printText && i < header.numRecords; i++)
+            if (dense[i] != 0) printf("%lu %lu\n", (unsigned long) i, (unsigned long) dense[i]);
+
+        free(dense);
+        free(block);
+    } else {
+        // Sparse shards are merged all at once, straight into the output, which is removed if any is not valid.
+        ShardHeader merged = header;
+        FILE *out = startShard(outName, &merged);
+        if (out == NULL) return EXIT_FAILURE;
+
+        status = mergeSparseShards(argv + first, argc - first, &header, out, outName, &merged, printText);
+        if (finishShard(out, outName, &merged) == -1) status = -1;
+        if (status == -1) remove(outName);
+        header = merged;
+    }
+
+    if (status == 0)
+        printf("Merged %d shard(s) of %lu possible buckets into '%s', with a total count of %lu.\n", argc - first,
+               (unsigned long) header.numBuckets, outName, (unsigned long) header.total);
+
+    return (status == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,240 @@
+//
+// Binary histogram shards, written by each rank of cwk2.c and summed by cwk2_merge.c. A shard is one
+// histogram in a fixed-width, versioned format: a 64-byte header, then the counts as 64-bit integers in
+// the machine's byte order (little-endian on x86), so shards from many ranks or jobs can be added without
+// parsing any text. Does not need MPI.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+
+#define SHARD_MAGIC   "CWK2SHRD"
+#define SHARD_VERSION 1
+
+//
+// Layouts of the counts after the header:
+// SHARD_DENSE  - numBuckets counts, in order of key.
+// SHARD_SPARSE - numRecords (key, count) pairs, in increasing order of key and with no zero counts.
+//
+#define SHARD_DENSE  0
+#define SHARD_SPARSE 1
+
+// Counts read and added at a time when merging dense shards.
+#define SHARD_BLOCK (1L << 16)
+
+
+typedef struct {
+    char magic[8];          // SHARD_MAGIC, without its '\0'.
+    uint32_t version;       // SHARD_VERSION.
+    uint32_t kind;          // One of the BUCKET_... codes in cwk2_buckets.h; letters are BUCKET_KGRAM with k=1.
+    uint32_t k;             // Gram length for BUCKET_KGRAM, else 1.
+    uint32_t layout;        // SHARD_DENSE or SHARD_SPARSE.
+    uint64_t numBuckets;    // Number of possible buckets.
+    uint64_t numRecords;    // Counts or pairs that follow.
+    uint64_t total;         // Sum of all the counts, to check a shard was read in full.
+    uint64_t reserved[2];   // Zero.
+} ShardHeader;
+
+typedef struct {
+    uint64_t key;
+    uint64_t count;
+} ShardRecord;
+
+
+void initShardHeader(ShardHeader *header, int kind, int k, uint64_t numBuckets, int layout, uint64_t numRecords) {
+    memset(header, 0, sizeof(ShardHeader));
+    memcpy(header->magic, SHARD_MAGIC, sizeof(header->magic));
+    header->version = SHARD_VERSION;
+    header->kind = (uint32_t) kind;
+    header->k = (uint32_t) k;
+    header->layout = (uint32_t) layout;
+    header->numBuckets = numBuckets;
+    header->numRecords = numRecords;
+}
+
+// Writes the header and its counts (uint64_t for SHARD_DENSE, ShardRecord for SHARD_SPARSE), filling in the
+// total. Returns 0 if okay, -1 after printing an error message if not.
+int writeShard(const char *fname, ShardHeader *header, const void *data) {
+    uint64_t i;
+
+    header->total = 0;
+    for (i = 0; i < header->numRecords; i++)
+        header->total += (header->layout == SHARD_DENSE ? ((const uint64_t *) data)[i]
+                                                        : ((const ShardRecord *) data)[i].count);
+
+    size_t recordSize = (header->layout == SHARD_DENSE ? sizeof(uint64_t) : sizeof(ShardRecord));
+    FILE *file = fopen(fname, "wb");
+    if (file == NULL) {
+        printf("Could not open the shard '%s' for output.\n", fname);
+        return -1;
+    }
+
+    int okay = (fwrite(header, sizeof(ShardHeader), 1, file) == 1 &&
+                fwrite(data, recordSize, header->numRecords, file) == header->numRecords);
+    if (fclose(file) || !okay) {
+        printf("Could not write the shard '%s'.\n", fname);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Starts a shard whose records are written a few at a time, e.g. as they are merged, writing the header as it
+// stands for now; finishShard() then fills in the number of records and the total. Returns NULL after printing
+// an error message if the file could not be opened.
+FILE *startShard(const char *fname, const ShardHeader *header) {
+    FILE *file = fopen(fname, "wb");
+    if (file == NULL || fwrite(header, sizeof(ShardHeader), 1, file) != 1) {
+        printf("Could not open the shard '%s' for output.\n", fname);
+        if (file != NULL) fclose(file);
+        return NULL;
+    }
+    return file;
+}
+
+// Rewrites the header of a shard begun by startShard() with its final number of records and total, and closes
+// it. Returns 0 if okay, -1 after printing an error message if not.
+int finishShard(FILE *file, const char *fname, const ShardHeader *header) {
+    int okay = (!ferror(file) && fseek(file, 0, SEEK_SET) == 0 && fwrite(header, sizeof(ShardHeader), 1, file) == 1);
+    if (fclose(file) || !okay) {
+        printf("Could not write the shard '%s'.\n", fname);
+        return -1;
+    }
+    return 0;
+}
+
+// Opens a shard and reads its header, leaving the file at the first count. Returns NULL after printing an
+// error message if it is not a shard of this version.
+FILE *openShard(const char *fname, ShardHeader *header) {
+    FILE *file = fopen(fname, "rb");
+    if (file == NULL) {
+        printf("Could not open the shard '%s' for reading.\n", fname);
+        return NULL;
+    }
+
+    if (fread(header, sizeof(ShardHeader), 1, file) != 1 || memcmp(header->magic, SHARD_MAGIC, sizeof(header->magic))) {
+        printf("'%s' is not a histogram shard.\n", fname);
+        fclose(file);
+        return NULL;
+    }
+    if (header->version != SHARD_VERSION) {
+        printf("Shard '%s' has version %u, but only version %d can be read.\n", fname, header->version, SHARD_VERSION);
+        fclose(file);
+        return NULL;
+    }
+    if (header->layout != SHARD_DENSE && header->layout != SHARD_SPARSE) {
+        printf("Shard '%s' has an unknown layout %u.\n", fname, header->layout);
+        fclose(file);
+        return NULL;
+    }
+
+    return file;
+}
+
+// Returns 1 if the two shards count the same buckets in the same layout, 0 if not.
+int shardsCompatible(const ShardHeader *a, const ShardHeader *b) {
+    return (a->kind == b->kind && a->k == b->k && a->numBuckets == b->numBuckets && a->layout == b->layout);
+}
+
+
+//
+// Merging.
+//
+
+// Adds n counts to sum[]. The loop is simple enough to be vectorised, several counts per instruction.
+void addShardCounts(uint64_t *restrict sum, const uint64_t *restrict counts, long n) {
+    long i;
+
+#pragma omp simd
+    for (i = 0; i < n; i++) sum[i] += counts[i];
+}
+
+// Records read at a time from each shard in a merge of sparse shards.
+#define SHARD_READ_BLOCK (1L << 12)
+
+// A sparse shard read one record at a time in order of key, a block at a time from the file, for a k-way merge.
+typedef struct {
+    FILE *file;
+    const char *fname;
+    ShardHeader header;
+    ShardRecord *block;     // SHARD_READ_BLOCK records.
+    long numInBlock;        // Records read into block[].
+    long next;              // Index in block[] of the record after current.
+    uint64_t numRead;       // Records taken from the file so far, including current.
+    uint64_t total;         // Sum of their counts.
+    ShardRecord current;    // The record with the smallest key not yet merged.
+} ShardReader;
+
+// Moves the reader on to its next record, checking the keys increase and are in range, and that the counts
+// add up to the header's total once all are read. Returns 1 if there was one, 0 at the end of the shard, or
+// -1 after printing an error message if the shard is not valid.
+int advanceShardReader(ShardReader *reader) {
+    if (reader->numRead == reader->header.numRecords) {
+        if (reader->total != reader->header.total) {
+            printf("Shard '%s' does not add up to its total.\n", reader->fname);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (reader->next == reader->numInBlock) {
+        uint64_t left = reader->header.numRecords - reader->numRead;
+        long n = (left < SHARD_READ_BLOCK ? (long) left : SHARD_READ_BLOCK);
+        if (fread(reader->block, sizeof(ShardRecord), n, reader->file) != (size_t) n) {
+            printf("Shard '%s' is shorter than its header says.\n", reader->fname);
+            return -1;
+        }
+        reader->numInBlock = n;
+        reader->next = 0;
+    }
+
+    ShardRecord record = reader->block[reader->next++];
+    if (record.key >= reader->header.numBuckets || (reader->numRead > 0 && record.key <= reader->current.key)) {
+        printf("Shard '%s' has keys out of order or range.\n", reader->fname);
+        return -1;
+    }
+
+    reader->current = record;
+    reader->numRead++;
+    reader->total += record.count;
+    return 1;
+}
+
+// Opens a sparse shard for reading with advanceShardReader(), and reads its first record. Returns as that does,
+// so 0 for a shard with no records, which is then already closed.
+int openShardReader(ShardReader *reader, const char *fname) {
+    reader->fname = fname;
+    reader->block = NULL;
+    if ((reader->file = openShard(fname, &reader->header)) == NULL) return -1;
+
+    if (reader->header.layout != SHARD_SPARSE) {
+        printf("Shard '%s' is not sparse.\n", fname);
+        fclose(reader->file);
+        return -1;
+    }
+    if ((reader->block = (ShardRecord *) malloc(SHARD_READ_BLOCK * sizeof(ShardRecord))) == NULL) {
+        printf("Could not allocate memory for reading the shard '%s'.\n", fname);
+        fclose(reader->file);
+        return -1;
+    }
+    reader->numInBlock = reader->next = 0;
+    reader->numRead = reader->total = 0;
+
+    int status = advanceShardReader(reader);
+    if (status != 1) {
+        fclose(reader->file);
+        free(reader->block);
+        reader->block = NULL;
+    }
+    return status;
+}
+
+void closeShardReader(ShardReader *reader) {
+    if (reader->block == NULL) return;
+    fclose(reader->file);
+    free(reader->block);
+    reader->block = NULL;
+}
@@ -0,0 +1,88 @@
+//
+// Per-phase timers for cwk2.c. Every rank times its own part of each phase with MPI_Wtime(); the times are
+// then combined over the ranks into the minimum, mean and maximum, with the throughput of the phase and
+// its load imbalance. Needs mpi.h.
+//
+
+
+//
+// Phases. A rank that takes no part in a phase (e.g. reading, which is only done by rank 0 unless
+// using MPI-IO) counts as taking no time, so the spread shows who waits on whom.
+//
+#define PHASE_READ    0
+#define PHASE_BCAST   1
+#define PHASE_SCATTER 2
+#define PHASE_COUNT   3
+#define PHASE_REDUCE  4
+#define PHASE_SAVE    5
+#define NUM_PHASES    6
+
+const char *phaseNames[] = {"read", "bcast", "scatter", "count", "reduce", "save"};
+
+
+typedef struct {
+    double seconds[NUM_PHASES];     // Time this rank spent in each phase.
+    long bytes[NUM_PHASES];         // Bytes this rank read, sent, received or counted in each phase.
+} PhaseTimers;
+
+
+void initPhaseTimers(PhaseTimers *timers) {
+    int phase;
+
+    for (phase = 0; phase < NUM_PHASES; phase++) {
+        timers->seconds[phase] = 0.0;
+        timers->bytes[phase] = 0;
+    }
+}
+
+// Adds the time since 'since' and the bytes to the phase, returning the current time to start the next.
+double lapPhase(PhaseTimers *timers, int phase, long bytes, double since) {
+    double now = MPI_Wtime();
+
+    timers->seconds[phase] += now - since;
+    timers->bytes[phase] += bytes;
+    return now;
+}
+
+// Combines the timers over all ranks, and prints a table on rank 0. If csvFile is not NULL, rank 0 also
+// appends one line per phase to it, starting with the given fields (e.g. the run's settings) and writing
+// csvHeader first if the file is empty. Must be called by all ranks.
+void reportPhaseTimers(const PhaseTimers *timers, int rank, int numProcs, const char *csvFile,
+                       const char *csvHeader, const char *csvFields) {
+    double minSeconds[NUM_PHASES], maxSeconds[NUM_PHASES], sumSeconds[NUM_PHASES];
+    long sumBytes[NUM_PHASES];
+    int phase;
+
+    MPI_Reduce(timers->seconds, minSeconds, NUM_PHASES, MPI_DOUBLE, MPI_MIN, 0, MPI_COMM_WORLD);
+    MPI_Reduce(timers->seconds, maxSeconds, NUM_PHASES, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(timers->seconds, sumSeconds, NUM_PHASES, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(timers->bytes, sumBytes, NUM_PHASES, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    if (rank != 0) return;
+
+    FILE *csv = NULL;
+    if (csvFile != NULL) {
+        csv = fopen(csvFile, "a");
+        if (csv == NULL)
+            printf("Could not open '%s' for the timings.\n", csvFile);
+        else if (ftell(csv) == 0)
+            fprintf(csv, "%s,phase,min_s,mean_s,max_s,bytes,bytes_per_s,imbalance\n", csvHeader);
+    }
+
+    // Throughput is limited by the slowest rank. The imbalance is how much longer that rank took than the
+    // mean, as a fraction of the mean: zero when perfectly balanced.
+    printf("\nPhase      min (s)    mean (s)   max (s)    bytes         bytes/s      imbalance\n");
+    for (phase = 0; phase < NUM_PHASES; phase++) {
+        double mean = sumSeconds[phase] / numProcs;
+        double rate = (maxSeconds[phase] > 0.0 ? sumBytes[phase] / maxSeconds[phase] : 0.0);
+        double imbalance = (mean > 0.0 ? maxSeconds[phase] / mean - 1.0 : 0.0);
+
+        printf("%-9s  %-9.3g  %-9.3g  %-9.3g  %-12ld  %-11.4g  %.1f%%\n", phaseNames[phase], minSeconds[phase], mean,
+               maxSeconds[phase], sumBytes[phase], rate, 100.0 * imbalance);
+        if (csv != NULL)
+            fprintf(csv, "%s,%s,%g,%g,%g,%ld,%g,%g\n", csvFields, phaseNames[phase], minSeconds[phase], mean,
+                    maxSeconds[phase], sumBytes[phase], rate, imbalance);
+    }
+
+    if (csv != NULL) fclose(csv);
+}
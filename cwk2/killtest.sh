@@ -0,0 +1,59 @@
+#!/bin/sh
+#
+# Kills one worker rank with SIGKILL part way through a run that records its progress, then resumes the run and
+# checks it against the serial count. The input is input.txt repeated, handed out in small pieces so the run is
+# still going when the worker is killed. Run with 'make resume'; NP, PIECE and COPIES can be overridden, e.g.
+# 'make resume NP=8 PIECE=4096'.
+#
+
+NP=${NP:-4}
+PIECE=${PIECE:-65536}
+COPIES=${COPIES:-64}
+TEXT=killtest.txt
+LOG=killtest.log
+
+# The copied input is large, so is removed however the script exits.
+trap 'rm -f $TEXT' EXIT
+
+rm -f $LOG
+i=0
+while [ $i -lt $COPIES ]; do cat input.txt; i=$((i + 1)); done > $TEXT
+
+mpiexec -n $NP -oversubscribe ./cwk2 -progress $LOG -piece $PIECE $TEXT > killtest.out 2>&1 &
+RUN=$!
+
+# Rank 1 is always a worker. Its process is found from the rank Open MPI or MPICH put in its environment.
+VICTIM=
+while [ -z "$VICTIM" ] && kill -0 $RUN 2>/dev/null; do
+    for pid in $(pgrep -f "cwk2 -progress $LOG"); do
+        if tr '\0' '\n' < /proc/$pid/environ 2>/dev/null | grep -q -x -e "OMPI_COMM_WORLD_RANK=1" -e "PMI_RANK=1"; then
+            VICTIM=$pid
+        fi
+    done
+done
+
+# Wait for the header (the version, the file count and one line per file) and a few records.
+while [ "$(cat $LOG 2>/dev/null | wc -l)" -lt 10 ] && kill -0 $RUN 2>/dev/null; do sleep 0.01; done
+
+if [ -z "$VICTIM" ] || ! kill -0 $RUN 2>/dev/null; then
+    echo "The run finished before rank 1 could be killed; try a smaller PIECE or more COPIES."
+    wait $RUN
+    exit 1
+fi
+
+# The other workers carry on with the remaining pieces until mpiexec notices and stops the job, so the piece
+# rank 1 held is the least that is left to do.
+KILLED_AT=$(($(wc -l < $LOG) - 3))
+kill -9 $VICTIM
+wait $RUN
+echo "Killed rank 1 (process $VICTIM) after $KILLED_AT pieces were recorded; $(($(wc -l < $LOG) - 3)) were by the end."
+
+mpiexec -n $NP -oversubscribe ./cwk2 -progress $LOG -piece $PIECE -resume $TEXT > killtest.out 2>&1
+grep "Resuming" killtest.out
+
+if grep -q "same values as the serial check" killtest.out; then
+    echo "The resumed run matches the serial check."
+else
+    echo "The resumed run does not match the serial check; see killtest.out."
+    exit 1
+fi
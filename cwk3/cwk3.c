@@ -53,34 +53,65 @@ int main( int argc, char **argv )
 	// Allocate memory n the device
 	cl_mem device_gradients = clCreateBuffer( context, CL_MEM_READ_ONLY  | CL_MEM_COPY_HOST_PTR, N*  sizeof(float), gradients, &status);
 	cl_mem device_inputs    = clCreateBuffer( context, CL_MEM_READ_ONLY  | CL_MEM_COPY_HOST_PTR,   M*sizeof(float), inputs,     &status);
-	cl_mem device_weights   = clCreateBuffer( context, CL_MEM_WRITE_ONLY | CL_MEM_COPY_HOST_PTR, N*M*sizeof(float), weights,   &status);
+	cl_mem device_weights   = clCreateBuffer( context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, N*M*sizeof(float), weights,   &status);
 
 	// 
 	// Perform calculations on the GPU
 	//
-	cl_kernel kernel = compileKernelFromFile( "cwk3.cl", "weightsUpdate", context, device );
+	// When M is a multiple of 4, each work-item updates four consecutive weights of one row with vector loads
+	// and stores, over a 2D index space of M/4 columns by N rows. Otherwise, one work-item per weight. The
+	// vectorised path has not yet been run on a GPU; the comparison with the serial result below checks it.
+	int vectorised = ( M%4==0 );
+	cl_kernel kernel = compileKernelFromFile( "cwk3.cl", vectorised ? "weightsUpdateVec4" : "weightsUpdate", context, device );
 	
 	status = clSetKernelArg( kernel, 0, sizeof(cl_mem), &device_gradients);
 	status = clSetKernelArg( kernel, 1, sizeof(cl_mem), &device_inputs);
 	status = clSetKernelArg( kernel, 2, sizeof(cl_mem), &device_weights);
-	status = clSetKernelArg( kernel, 3, sizeof(int), &M);
-	status = clSetKernelArg( kernel, 4, sizeof(int), &N);
+	if( !vectorised )
+	{
+		status = clSetKernelArg( kernel, 3, sizeof(int), &M);
+		status = clSetKernelArg( kernel, 4, sizeof(int), &N);
+	}
 
 	// Get max wor items
 	size_t maxWorkItems;
 	clGetDeviceInfo( device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t), &maxWorkItems, NULL);
 
-	// Set up global problem size, and work group size
-	size_t indexSpaceSize[1], workGroupSize[1];
-	indexSpaceSize[0] = N*M;
-	workGroupSize[0] = maxWorkItems;
-
-	if (workGroupSize[0] > N*M) {
-		printf("Work size bigger than index size, Defaulting to index size\n");
-		workGroupSize[0] = N*M;
+	if( vectorised )
+	{
+		// Each dimension of a work group has its own limit as well as the total.
+		size_t maxItemSizes[3];
+		clGetDeviceInfo( device, CL_DEVICE_MAX_WORK_ITEM_SIZES, sizeof(maxItemSizes), maxItemSizes, NULL);
+
+		// Work groups along a row first, then over as many rows as fit. Each size is then reduced until it
+		// divides the index space, which it already does when everything is a power of 2.
+		size_t indexSpaceSize[2], workGroupSize[2];
+		indexSpaceSize[0] = M/4;
+		indexSpaceSize[1] = N;
+		workGroupSize[0] = ( indexSpaceSize[0] < maxWorkItems ? indexSpaceSize[0] : maxWorkItems );
+		if( workGroupSize[0] > maxItemSizes[0] ) workGroupSize[0] = maxItemSizes[0];
+		while( indexSpaceSize[0] % workGroupSize[0] ) workGroupSize[0]--;
+
+		workGroupSize[1] = ( indexSpaceSize[1] < maxWorkItems/workGroupSize[0] ? indexSpaceSize[1] : maxWorkItems/workGroupSize[0] );
+		if( workGroupSize[1] > maxItemSizes[1] ) workGroupSize[1] = maxItemSizes[1];
+		while( indexSpaceSize[1] % workGroupSize[1] ) workGroupSize[1]--;
+
+		status = clEnqueueNDRangeKernel( queue, kernel, 2, NULL, indexSpaceSize, workGroupSize, 0, NULL, NULL);
 	}
+	else
+	{
+		// Set up global problem size, and work group size
+		size_t indexSpaceSize[1], workGroupSize[1];
+		indexSpaceSize[0] = N*M;
+		workGroupSize[0] = maxWorkItems;
+
+		if (workGroupSize[0] > N*M) {
+			printf("Work size bigger than index size, Defaulting to index size\n");
+			workGroupSize[0] = N*M;
+		}
 
-	status = clEnqueueNDRangeKernel( queue, kernel, 1, NULL, indexSpaceSize, workGroupSize, 0, NULL, NULL);
+		status = clEnqueueNDRangeKernel( queue, kernel, 1, NULL, indexSpaceSize, workGroupSize, 0, NULL, NULL);
+	}
 
 	if( status != CL_SUCCESS )
 	{
@@ -106,6 +137,19 @@ int main( int argc, char **argv )
 		}
 	}
 
+	// Compare with the serial result, so either kernel is checked on every run and not just by eye. Both do one
+	// multiply and one add per weight, but the device may fuse them, so allow for rounding.
+	int mismatches = 0;
+	for(int i = 0; i < N*M; i++){
+		float diff = weights[i] - weightsSerial[i], scale = ( weightsSerial[i] < 0 ? -weightsSerial[i] : weightsSerial[i] );
+		if( ( diff < 0 ? -diff : diff ) > 1e-5f * ( scale > 1.0f ? scale : 1.0f ) ) mismatches++;
+	}
+	if( mismatches )
+		printf( "WARNING: %d of %d weights from the %s kernel differ from the serial calculation.\n", mismatches, N*M,
+			vectorised ? "weightsUpdateVec4" : "weightsUpdate" );
+	else
+		printf( "Weights from the %s kernel match the serial calculation.\n", vectorised ? "weightsUpdateVec4" : "weightsUpdate" );
+
 	// Output result to screen. DO NOT REMOVE THIS LINE (or alter displayWeights() in helper_cwk.h); this will be replaced
 	// with a different displayWeights() for the the assessment, so any changes you might make will be lost.
 	displayWeights( weights, N, M) ;								// DO NOT REMOVE.
@@ -114,6 +158,7 @@ int main( int argc, char **argv )
 	free( gradients );
 	free( inputs    );
 	free( weights   );
+	free( weightsSerial );
 
 	clReleaseCommandQueue( queue   );
 	clReleaseContext     ( context );
@@ -11,3 +11,19 @@ void  weightsUpdate(__global float *gradients, __global float *inputs, __global
 	// Perform the weights editing
 	weights[gid] += gradients[gid / device_M] * inputs[gid % device_M];
 }
+
+// As weightsUpdate, but over a 2D index space: dimension 0 steps along a row four columns at a time, and
+// dimension 1 is the row. Each work-item loads its row's gradient once and updates four consecutive weights
+// with one vector load and store, with no divide or modulo. Needs M to be a multiple of 4.
+__kernel
+void  weightsUpdateVec4(__global const float *gradients, __global const float4 *inputs, __global float4 *weights)
+{
+	int col = get_global_id(0), row = get_global_id(1);
+
+	// M/4 vectors per row.
+	int rowLength = get_global_size(0);
+
+	float gradient = gradients[row];
+
+	weights[row*rowLength + col] += gradient * inputs[col];
+}